@@ -9,6 +9,8 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
+#include <stdint.h>
 
 #include <epicsTypes.h>
 #include <dbCommon.h>
@@ -20,10 +22,14 @@
 #include <alarm.h>
 #include <dbScan.h>
 #include <dbAccess.h>
+#include <callback.h>
+#include <epicsThread.h>
+#include <epicsMessageQueue.h>
 #include <epicsExport.h>
 
 #include <pevulib.h>
 #include <pevxulib.h>
+#include "toscaPev.h"
 
 #define I2CEXEC_OK      0x0200000
 #define I2CEXEC_MASK    0x0300000
@@ -33,6 +39,10 @@
 #include "toscaDebug.h"
 epicsExportAddress(int, ifc1210Debug);
 
+/* BMR values younger than this (seconds) are shared between records */
+double ifc1210BmrCacheTime = 0.1;
+epicsExportAddress(double, ifc1210BmrCacheTime);
+
 long  ifc1210Init(){ pev_init(0); return 0; }
 struct {
     long number;
@@ -52,8 +62,137 @@ typedef struct ifcPrivate{
     IfcDevType devType;
     unsigned int card;
     unsigned int count;
+    pevElbHandle elb;
+    /* asynchronous BMR read */
+    dbCommon* record;
+    CALLBACK callback;
+    unsigned int rval;
+    int status;
+    int err;    /* errno of the read, set in the worker thread */
 } ifcPrivate;
 
+/* BMR reads are I2C transactions taking milliseconds.
+   Records pass them to a worker thread and complete with
+   callbackRequestProcessCallback.
+   The worker keeps a short-lived cache thus records reading
+   the same BMR register share one bus transaction.
+   Writes (in any thread) invalidate the cache.
+*/
+
+#define BMR_CACHE_SIZE 64
+
+static epicsMessageQueueId bmrQueue;
+static volatile unsigned long bmrWrites;
+
+static struct {
+    unsigned int card, address, count;
+    unsigned int rval;
+    unsigned long writes;
+    uint64_t time;  /* ns, 0 if unused */
+} bmrCache[BMR_CACHE_SIZE];
+
+static uint64_t devIfc1210Now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void devIfc1210BmrWorker(void* dummy __attribute__((unused)))
+{
+    ifcPrivate* p;
+    unsigned int i, oldest;
+    uint64_t now;
+
+    while (epicsMessageQueueReceive(bmrQueue, &p, sizeof(p)) >= 0)
+    {
+        now = devIfc1210Now();
+        oldest = 0;
+        for (i = 0; i < BMR_CACHE_SIZE; i++)
+        {
+            if (bmrCache[i].time < bmrCache[oldest].time) oldest = i;
+            if (bmrCache[i].time && bmrCache[i].card == p->card &&
+                bmrCache[i].address == p->address && bmrCache[i].count == p->count) break;
+        }
+        if (i < BMR_CACHE_SIZE && bmrCache[i].writes == bmrWrites &&
+            now - bmrCache[i].time < ifc1210BmrCacheTime * 1e9)
+        {
+            debugLvl(2, "%s: cached bmr=%d addr=%d", p->record->name, p->card, p->address);
+            p->rval = bmrCache[i].rval;
+            p->status = I2CEXEC_OK;
+            p->err = 0;
+        }
+        else
+        {
+            unsigned long writes = bmrWrites;
+            p->status = pev_bmr_read(p->card, p->address, &p->rval, p->count);
+            p->err = errno;
+            if ((p->status&I2CEXEC_MASK) == I2CEXEC_OK)
+            {
+                if (i == BMR_CACHE_SIZE) i = oldest;
+                bmrCache[i].card = p->card;
+                bmrCache[i].address = p->address;
+                bmrCache[i].count = p->count;
+                bmrCache[i].rval = p->rval;
+                bmrCache[i].writes = writes;
+                bmrCache[i].time = now;
+            }
+            else if (i < BMR_CACHE_SIZE)
+                bmrCache[i].time = 0;
+        }
+        callbackRequestProcessCallback(&p->callback, priorityLow, p->record);
+    }
+}
+
+static int devIfc1210BmrStart(void)
+{
+    if (bmrQueue) return 0;
+    if (!(bmrQueue = epicsMessageQueueCreate(256, sizeof(ifcPrivate*))))
+        return -1;
+    if (!epicsThreadCreate("bmr-TOSCA", epicsThreadPriorityLow,
+        epicsThreadGetStackSize(epicsThreadStackSmall),
+        devIfc1210BmrWorker, NULL))
+    {
+        error("cannot start BMR worker thread");
+        epicsMessageQueueDestroy(bmrQueue);
+        bmrQueue = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Returns 0 when rval is valid, 1 if the record waits for the worker */
+static int devIfc1210BmrRead(dbCommon* record, ifcPrivate* p, unsigned int* rval)
+{
+    if (!record->pact)
+    {
+        if (bmrQueue && epicsMessageQueueTrySend(bmrQueue, &p, sizeof(p)) == 0)
+        {
+            record->pact = 1;
+            return 1;
+        }
+        debugLvl(1, "%s: BMR queue full, reading synchronously", record->name);
+        p->status = pev_bmr_read(p->card, p->address, &p->rval, p->count);
+        p->err = errno;
+    }
+    if ((p->status&I2CEXEC_MASK) != I2CEXEC_OK)
+    {
+        errno = p->err;
+        error("%s: pev_bmr_read bmr=%d addr=%d failed: %m",
+            record->name, p->card, p->address);
+        recGblSetSevr(record, READ_ALARM, INVALID_ALARM);
+        return -1;
+    }
+    *rval = p->rval;
+    return 0;
+}
+
+static void devIfc1210BmrWrite(ifcPrivate* p, unsigned int value)
+{
+    pev_bmr_write(p->card, p->address, value, p->count);
+    __sync_fetch_and_add(&bmrWrites, 1);
+}
+
 long devIfc1210InitRecord(dbCommon* record, struct link* link)
 {
     ifcPrivate* p;
@@ -72,6 +211,7 @@ long devIfc1210InitRecord(dbCommon* record, struct link* link)
     }
     p->address = link->value.vmeio.signal;
     p->card  = link->value.vmeio.card;
+    p->record = record;
 
     if(strncmp(link->value.vmeio.parm, "ELB", 3) == 0)
     {
@@ -119,11 +259,35 @@ long devIfc1210InitRecord(dbCommon* record, struct link* link)
         free(p);
         return S_db_badField;
     }
+    if (p->devType >= BMR && devIfc1210BmrStart() != 0)
+    {
+        recGblRecordError(S_db_noMemory, record,
+            "devIfc1210InitRecord: cannot start BMR worker");
+        free(p);
+        return S_db_noMemory;
+    }
 
     record->dpvt = p;
     return 0;
 }
 
+/* Resolve the ELB address once instead of at each access */
+static long devIfc1210InitElb(dbCommon* record)
+{
+    ifcPrivate* p = record->dpvt;
+
+    if (p->devType != IFC_ELB) return 0;
+    if (pevx_elb_handle(0, p->address, &p->elb) != 0)
+    {
+        recGblRecordError(S_db_badField, record,
+            "devIfc1210InitRecord: invalid ELB address");
+        free(p);
+        record->dpvt = NULL;
+        return S_db_badField;
+    }
+    return 0;
+}
+
 /*************** ai record ****************/
 #include <aiRecord.h>
 
@@ -132,6 +296,8 @@ long devIfc1210AiInitRecord(aiRecord* record)
    int status=0;
    status = devIfc1210InitRecord((dbCommon*) record, &record->inp);
    if (status != 0) return status;
+   status = devIfc1210InitElb((dbCommon*) record);
+   if (status != 0) return status;
    record->udf = 0;
    return 0;
 }
@@ -140,7 +306,7 @@ long devIfc1210AiRead(aiRecord* record)
 {
     ifcPrivate* p = record->dpvt;
     unsigned int rval = 0;
-    int status = 0;
+    int status;
 
     if (p == NULL)
     {
@@ -153,7 +319,7 @@ long devIfc1210AiRead(aiRecord* record)
     switch (p->devType)
     {
         case IFC_ELB:
-            rval = pev_elb_rd( p->address );
+            rval = pev_elb_handle_rd( &p->elb );
             break;
         case IFC_SMON:
         case IFC_SMON_10S:
@@ -163,14 +329,9 @@ long devIfc1210AiRead(aiRecord* record)
             rval = pev_csr_rd( p->address | 0x80000000 );
             break;
         default:
-            status = pev_bmr_read( p->card,  p->address, &rval, p->count);
-            if((status&I2CEXEC_MASK) != I2CEXEC_OK)
-            {
-                error("%s: pev_bmr_read bmr=%d addr=%d failed: %m",
-                    record->name, p->card, p->address);
-                recGblSetSevr(record, READ_ALARM, INVALID_ALARM);
-                return -1;
-            }
+            status = devIfc1210BmrRead((dbCommon*) record, p, &rval);
+            if (status < 0) return status;
+            if (status > 0) return 0; /* completes later */
     }
 
     switch (p->devType)
@@ -221,6 +382,8 @@ long devIfc1210AoInitRecord(aoRecord* record)
    int status=0;
    status = devIfc1210InitRecord((dbCommon*) record, &record->out);
    if (status != 0) return status;
+   status = devIfc1210InitElb((dbCommon*) record);
+   if (status != 0) return status;
    record->udf = 0;
    return 2;
 }
@@ -238,7 +401,7 @@ long devIfc1210AoWrite(aoRecord* record)
     }
 
     if(p->devType == IFC_ELB)
-        pev_elb_wr( p->address, record->rval );
+        pev_elb_handle_wr( &p->elb, record->rval );
     else
     if(p->devType == IFC_SMON)
         pev_smon_wr( p->address, record->rval );
@@ -247,7 +410,7 @@ long devIfc1210AoWrite(aoRecord* record)
         pev_csr_wr( p->address | 0x80000000, record->rval);
     else
     if(p->devType == BMR)
-        pev_bmr_write(p->card, p->address, record->rval, p->count);
+        devIfc1210BmrWrite(p, record->rval);
 
     return 0;
 }
@@ -279,6 +442,8 @@ long devIfc1210LonginInitRecord(longinRecord* record)
    int status=0;
    status = devIfc1210InitRecord((dbCommon*) record, &record->inp);
    if (status != 0) return status;
+   status = devIfc1210InitElb((dbCommon*) record);
+   if (status != 0) return status;
    record->udf = 0;
    return 0;
 }
@@ -287,7 +452,7 @@ long devIfc1210LonginRead(longinRecord* record)
 {
     ifcPrivate* p = record->dpvt;
     unsigned int rval = 0;
-    int status = 0;
+    int status;
 
     if (p == NULL)
     {
@@ -300,7 +465,7 @@ long devIfc1210LonginRead(longinRecord* record)
     switch (p->devType)
     {
         case IFC_ELB:
-            rval = pev_elb_rd( p->address );
+            rval = pev_elb_handle_rd( &p->elb );
             break;
         case IFC_SMON:
         case IFC_SMON_10S:
@@ -310,14 +475,9 @@ long devIfc1210LonginRead(longinRecord* record)
             rval = pev_csr_rd( p->address | 0x80000000 );
             break;
         default:
-            status = pev_bmr_read( p->card,  p->address, &rval, p->count);
-            if((status&I2CEXEC_MASK) != I2CEXEC_OK)
-            {
-                error("%s: pev_bmr_read bmr=%d addr=%d failed: %m",
-                    record->name, p->card, p->address);
-                recGblSetSevr(record, READ_ALARM, INVALID_ALARM);
-                return -1;
-            }
+            status = devIfc1210BmrRead((dbCommon*) record, p, &rval);
+            if (status < 0) return status;
+            if (status > 0) return 0; /* completes later */
     }
     switch (p->devType)
     {
@@ -363,6 +523,8 @@ long devIfc1210LongoutInitRecord(longoutRecord* record)
    int status=0;
    status = devIfc1210InitRecord((dbCommon*) record, &record->out);
    if (status != 0) return status;
+   status = devIfc1210InitElb((dbCommon*) record);
+   if (status != 0) return status;
    record->udf = 0;
    return 0;
 }
@@ -380,7 +542,7 @@ long devIfc1210LongoutWrite(longoutRecord* record)
     }
 
     if(p->devType == IFC_ELB)
-        pev_elb_wr( p->address, record->val );
+        pev_elb_handle_wr( &p->elb, record->val );
     else
     if(p->devType == IFC_SMON)
         pev_smon_wr( p->address, record->val );
@@ -389,7 +551,7 @@ long devIfc1210LongoutWrite(longoutRecord* record)
         pev_csr_wr( p->address | 0x80000000, record->val);
     else
     if(p->devType == BMR)
-        pev_bmr_write(p->card, p->address, record->val, p->count);
+        devIfc1210BmrWrite(p, record->val);
 
     return 0;
 }
@@ -457,7 +619,6 @@ long devIfc1210InitRecordStringin(stringinRecord* record)
 long devIfc1210ReadStringin(stringinRecord* record)
 {
     ifcPrivate* p = record->dpvt;
-    unsigned int i = 0;
 
     if (p == NULL || (p->devType != IFC_ELB))
     {
@@ -468,8 +629,13 @@ long devIfc1210ReadStringin(stringinRecord* record)
     }
     /* printf("devIfc1210ReadStringin(): p->address = %d p->count = %d\n", p->address, p->count); */
 
-    for(i=0; i < p->count/4; i++)
-      ((int*)record->val)[i] = pev_elb_rd( 0xe000 + p->address + i*4);
+    if (pevx_elb_rd_block(0, 0xe000 + p->address, p->count/4, (int*)record->val) != 0)
+    {
+        error("%s: pevx_elb_rd_block addr=0x%x count=%u failed: %m",
+            record->name, 0xe000 + p->address, p->count/4);
+        recGblSetSevr(record, READ_ALARM, INVALID_ALARM);
+        return -1;
+    }
 
     return 0;
 }
@@ -2,3 +2,6 @@
 #include "toscaReg.h"
 #include "toscaIntr.h"
 #include "toscaDma.h"
+#include "toscaStream.h"
+#include "toscaVmeErr.h"
+#include "toscaSlaveMem.h"
@@ -249,6 +249,7 @@ struct dmaRequest
     int source;
     int dest;
     long timeout;
+    struct timespec deadline;
     int flags;
     toscaDmaCallback callback;
     void *user;
@@ -303,6 +304,8 @@ int toscaDmaDoTransfer(struct dmaRequest* r)
     return 0;
 }
 
+unsigned long toscaDmaExpired;
+
 static int loopsRunning = 0;
 static int stopLoops = 0;
 
@@ -332,9 +335,22 @@ void* toscaDmaLoop()
             }
             else
             {
+                struct timespec now;
                 callback = r->callback;
                 user = r->user;
-                status = toscaDmaDoTransfer(r); /* blocks */
+                if (r->deadline.tv_sec)
+                    clock_gettime(CLOCK_MONOTONIC, &now);
+                if (r->deadline.tv_sec && (now.tv_sec > r->deadline.tv_sec ||
+                    (now.tv_sec == r->deadline.tv_sec && now.tv_nsec > r->deadline.tv_nsec)))
+                {
+                    debug("dropping request 0x%"PRIx64"->0x%"PRIx64" [0x%x] queued longer than %ld ms",
+                        r->req.src_addr, r->req.dst_addr, r->req.size, r->timeout);
+                    toscaDmaExpired++;
+                    if (r->flags & FLAG_CLOSE) toscaDmaRelease(r);
+                    status = ETIMEDOUT;
+                }
+                else
+                    status = toscaDmaDoTransfer(r); /* blocks */
                 callback(user, status);
             }
             LOCK;
@@ -372,6 +388,19 @@ int toscaDmaExecute(struct dmaRequest* r)
     if (r->callback)
     {
         debugLvl(2, "queuing: callback=%s(%p)", fname=symbolName(r->callback,0), r->user), free(fname);
+        if (r->timeout > 0)
+        {
+            /* drop request if still queued after timeout */
+            clock_gettime(CLOCK_MONOTONIC, &r->deadline);
+            r->deadline.tv_sec += r->timeout / 1000;
+            if ((r->deadline.tv_nsec += (r->timeout % 1000) * 1000000) >= 1000000000)
+            {
+                r->deadline.tv_nsec -= 1000000000;
+                r->deadline.tv_sec++;
+            }
+        }
+        else
+            r->deadline.tv_sec = 0;
         LOCK;
         if (!pending) WAKEUP;
         r->next = NULL;
@@ -383,6 +412,39 @@ int toscaDmaExecute(struct dmaRequest* r)
     else return toscaDmaDoTransfer(r);
 }
 
+static void toscaDmaIntrHandler(struct dmaRequest* r, int inum, int ivec)
+{
+    char* fname;
+    int status;
+
+    debugLvl(2, "inum=%d ivec=%d: starting DMA, callback=%s(%p)",
+        inum, ivec, fname=symbolName(r->callback,0), r->user), free(fname);
+    status = toscaDmaDoTransfer(r); /* blocks */
+    if (r->callback) r->callback(r->user, status);
+}
+
+int toscaDmaConnectIntr(intrmask_t intrmask, struct dmaRequest* r)
+{
+    debug("intrmask=0x%016"PRIx64" request=%p", intrmask, r);
+    if (!r || r->fd <= 0 || r->flags & FLAG_CLOSE)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return toscaIntrConnectHandler(intrmask, toscaDmaIntrHandler, r);
+}
+
+int toscaDmaDisconnectIntr(intrmask_t intrmask, struct dmaRequest* r)
+{
+    debug("intrmask=0x%016"PRIx64" request=%p", intrmask, r);
+    if (toscaIntrDisconnectHandler(intrmask, toscaDmaIntrHandler, r) == 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    return 0;
+}
+
 struct dmaRequest* toscaDmaRequestCreate(void)
 {
     struct dmaRequest* r;
@@ -422,6 +484,157 @@ void toscaDmaRelease(struct dmaRequest* r)
     UNLOCK;
 }
 
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+/* DMA buffer pool:
+   Buffers are carved page wise (first fit) from a few large regions which
+   are populated and locked once. Freed buffers go back to their region
+   and merge with free neighbours. Regions are never unmapped.
+   For the first page of each block, block[] holds its length in pages (| POOL_FREE).
+*/
+
+#define POOL_REGION_SIZE 0x400000 /* 4 MB, larger requests get their own region */
+#define POOL_FREE 0x80000000U
+
+struct dmaPoolRegion {
+    struct dmaPoolRegion* next;
+    char* base;
+    size_t pages;
+    uint32_t* block;
+};
+
+static struct dmaPoolRegion* dmaPool;
+static pthread_mutex_t dma_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct dmaPoolRegion* toscaDmaPoolAddRegion(size_t pages)
+{
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    struct dmaPoolRegion* region;
+    size_t size;
+
+    if (pages < POOL_REGION_SIZE / pagesize) pages = POOL_REGION_SIZE / pagesize;
+    size = pages * pagesize;
+    region = calloc(1, sizeof(struct dmaPoolRegion) + pages * sizeof(uint32_t));
+    if (!region) return NULL;
+    region->base = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0);
+    if (region->base == MAP_FAILED)
+    {
+        debugErrno("mmap 0x%zx bytes", size);
+        free(region);
+        return NULL;
+    }
+    if (mlock(region->base, size) != 0)
+        error("mlock 0x%zx bytes failed (using unlocked pages): %m", size);
+    region->pages = pages;
+    region->block = (uint32_t*)(region + 1);
+    region->block[0] = pages | POOL_FREE;
+    region->next = dmaPool;
+    dmaPool = region;
+    debug("new region %p 0x%zx bytes", region->base, size);
+    return region;
+}
+
+void* toscaDmaAlloc(size_t size)
+{
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    size_t pages = (size + pagesize - 1) / pagesize;
+    struct dmaPoolRegion* region;
+    size_t i, len;
+    char* p = NULL;
+
+    if (pages == 0) pages = 1;
+    if (pages >= POOL_FREE)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    pthread_mutex_lock(&dma_pool_mutex);
+    for (region = dmaPool; region; region = region->next)
+    {
+        for (i = 0; i < region->pages; i += len)
+        {
+            len = region->block[i] & ~POOL_FREE;
+            if ((region->block[i] & POOL_FREE) && len >= pages) break;
+        }
+        if (i < region->pages) break;
+    }
+    if (!region && (region = toscaDmaPoolAddRegion(pages)) != NULL)
+    {
+        i = 0;
+        len = region->pages;
+    }
+    if (region)
+    {
+        /* split, keep the rest free */
+        region->block[i] = pages;
+        if (len > pages)
+            region->block[i + pages] = (len - pages) | POOL_FREE;
+        p = region->base + i * pagesize;
+    }
+    pthread_mutex_unlock(&dma_pool_mutex);
+    if (!p) return NULL;
+    memset(p, 0, pages * pagesize);
+    debugLvl(2, "size=0x%zx: %p", size, p);
+    return p;
+}
+
+int toscaDmaIsPoolBuffer(const void* ptr)
+{
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    struct dmaPoolRegion* region;
+
+    pthread_mutex_lock(&dma_pool_mutex);
+    for (region = dmaPool; region; region = region->next)
+        if ((const char*)ptr >= region->base && (const char*)ptr < region->base + region->pages * pagesize) break;
+    pthread_mutex_unlock(&dma_pool_mutex);
+    return region != NULL;
+}
+
+void toscaDmaFree(void* ptr)
+{
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    struct dmaPoolRegion* region;
+    size_t i, prev, len;
+
+    if (!ptr) return;
+    debugLvl(2, "%p", ptr);
+    pthread_mutex_lock(&dma_pool_mutex);
+    for (region = dmaPool; region; region = region->next)
+        if ((char*)ptr >= region->base && (char*)ptr < region->base + region->pages * pagesize) break;
+    if (!region || ((char*)ptr - region->base) % pagesize ||
+        (region->block[i = ((char*)ptr - region->base) / pagesize] & POOL_FREE) ||
+        region->block[i] == 0)
+    {
+        pthread_mutex_unlock(&dma_pool_mutex);
+        error("%p is not an allocated DMA buffer", ptr);
+        return;
+    }
+    len = region->block[i];
+    /* merge with free successor */
+    if (i + len < region->pages && (region->block[i + len] & POOL_FREE))
+    {
+        len += region->block[i + len] & ~POOL_FREE;
+        region->block[i + region->block[i]] = 0;
+    }
+    region->block[i] = len | POOL_FREE;
+    /* merge with free predecessor */
+    for (prev = 0; prev < i; prev += region->block[prev] & ~POOL_FREE)
+    {
+        if (prev + (region->block[prev] & ~POOL_FREE) == i)
+        {
+            if (region->block[prev] & POOL_FREE)
+            {
+                region->block[prev] += len;
+                region->block[i] = 0;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dma_pool_mutex);
+}
+
 struct dmaRequest* toscaDmaSetup(unsigned int source, uint64_t source_addr, unsigned int dest, uint64_t dest_addr,
     size_t size, unsigned int swap, int timeout,
     toscaDmaCallback callback, void* user)
@@ -2,6 +2,7 @@
 #define toscaDma_h
 
 #include "toscaMap.h"
+#include "toscaIntr.h"
 #include "stdio.h"
 
 /* VME block transfer access modes from vme.h */
@@ -49,12 +50,24 @@ int toscaDmaExecute(struct dmaRequest*);
 /* Requests without callback will block */
 /* Requests with callback will not block and either return errno or call callback later */
 /* The callback function will be called with 0 or errno status */
+/* With timeout > 0 (ms), queued requests which did not start within timeout are dropped */
+/* with status ETIMEDOUT (counted in toscaDmaExpired). The kernel uses the same timeout to wait for a DMA channel. */
 /* Returns 0 on success or errno */
 
 void toscaDmaRelease(struct dmaRequest*);
 /* Releases a dmaRequest previously created with toscaDmaSetup() */
 /* Do not use the request handle any more after releasing it. */
 
+int toscaDmaConnectIntr(intrmask_t intrmask, struct dmaRequest*);
+/* Executes the prepared request directly in the interrupt handler thread whenever one of the interrupts in intrmask arrives. */
+/* Only the callback (if any) is delivered to the user, also in the interrupt handler thread. */
+/* The interrupt handler thread is blocked for the duration of the transfer. */
+/* Returns 0 on success or -1 and sets errno. */
+
+int toscaDmaDisconnectIntr(intrmask_t intrmask, struct dmaRequest*);
+/* Disconnects a request from interrupts. Do this before releasing the request. */
+/* Returns 0 on success or -1 and sets errno. */
+
 
 /* toscaDmaTransfer works like (toscaDmaSetup, toscaDmaExecute, toscaDmaRelease) */
 
@@ -75,12 +88,27 @@ static inline int toscaDmaRead(unsigned int source, uint64_t source_addr, void*
 }
 
 
+void* toscaDmaAlloc(size_t size);
+/* Allocates a page aligned, zeroed buffer for DMA to or from RAM. */
+/* Buffers come from a pool of large regions which are populated and locked once, */
+/* so the kernel does not need to fault in pages when pinning them for each transfer. */
+/* Returns NULL and sets errno on error. */
+
+void toscaDmaFree(void* ptr);
+/* Returns a buffer allocated with toscaDmaAlloc() to the pool. */
+
+int toscaDmaIsPoolBuffer(const void* ptr);
+/* Returns 1 if ptr points into the toscaDmaAlloc() pool, else 0. */
+
 void* toscaDmaLoop();
 /* Start this function in one or more threads to handle DMA requests with callback */
 
 int toscaDmaLoopsRunning(void);
 /* Returns number of running DMA loops. */
 
+extern unsigned long toscaDmaExpired;
+/* Number of requests dropped because their timeout expired in the queue. */
+
 void toscaDmaLoopsStop();
 /* Terminate all DMA loops. */
 /* Returns after all loops have stopped and no handler is active any more. */
@@ -13,6 +13,10 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <glob.h>
+#include <time.h>
+#include <semaphore.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 
 #include "symbolname.h"
 
@@ -45,15 +49,80 @@ pthread_mutex_t handlerlist_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 struct intr_handler {
     unsigned int device;
+    unsigned int index;
     void (*function)();
     void *parameter;
     struct intr_handler* next;
+    /* moderation */
+    uint64_t minInterval;             /* ns */
+    uint64_t batchTime;               /* ns */
+    unsigned long long batchCount;
+    unsigned long long pending;
+    uint64_t firstPending, lastCall;  /* ns */
+    struct intr_handler* nextModerated;
+    volatile int removed;
+    unsigned int flags;
 };
 
 static int intrFd[TOSCA_NUM_INTR];
 static unsigned long long totalIntrCount, intrCount[TOSCA_NUM_INTR];
 static struct intr_handler* handlers[TOSCA_NUM_INTR];
 
+/* Occupancy bitmaps of interrupt indices (32 indices per word):
+   intrMonitored: index has an open intrFd (never closed again)
+   intrHandled:   index has at least one handler installed
+*/
+#define INTR_BITMAP_WORDS ((TOSCA_NUM_INTR+31)/32)
+static uint32_t intrMonitored[INTR_BITMAP_WORDS];
+static uint32_t intrHandled[INTR_BITMAP_WORDS];
+#define BITMAP_SET(b,i)   ((b)[(i)>>5] |= 1U<<((i)&31))
+#define BITMAP_CLEAR(b,i) ((b)[(i)>>5] &= ~(1U<<((i)&31)))
+#define BITMAP_TEST(b,i)  (((b)[(i)>>5] >> ((i)&31)) & 1)
+
+/* Moderated handlers are pushed to the head with compare-and-swap
+   and are only unlinked by the interrupt thread after they have been
+   marked as removed. Thus the interrupt thread can walk the list without lock.
+*/
+static struct intr_handler* volatile moderatedHandlers;
+
+/* VME level gating:
+   vmeGated has a bit for each held level. The interrupt thread checks it before
+   calling handlers. Only if an interrupt actually arrives on a held level, its fd
+   is removed from epoll (intrGateMuted, vmeGateMuted[level] counts them)
+   and vmeGatePending tells the releasing thread to wake up the interrupt thread
+   with gateEvent to put them back.
+   Both sides set their own bit before checking the other one.
+   intrDisabled marks indices disabled with toscaIntrDisable. Releasing the
+   gate does not enable them and toscaIntrEnable leaves muted ones to the gate.
+*/
+static volatile uint32_t vmeGated, vmeGatePending;
+static uint32_t intrGateMuted[INTR_BITMAP_WORDS];
+static volatile uint32_t intrDisabled[INTR_BITMAP_WORDS];
+static unsigned int vmeGateMuted[8];
+static int gateEvent = -1;
+
+#if __GNUC__ * 100 + __GNUC_MINOR__ < 401
+/* We have no atomic compare-and-swap before GCC 4.1 */
+pthread_mutex_t atomic_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define __sync_synchronize()
+#define __sync_bool_compare_and_swap(p,o,n) ({ int _r; pthread_mutex_lock(&atomic_mutex); \
+    if ((_r = (*(p) == (o)))) *(p) = (n); pthread_mutex_unlock(&atomic_mutex); _r; })
+#define __sync_fetch_and_add(p,v) ({ typeof(*(p)) _o; pthread_mutex_lock(&atomic_mutex); \
+    _o = *(p); *(p) += (v); pthread_mutex_unlock(&atomic_mutex); _o; })
+#endif
+
+/* Hand-off queue from the interrupt thread (single producer) to the worker threads (multiple consumers) */
+#define INTR_WORK_QUEUE_SIZE 256  /* power of 2 */
+static struct intr_work {
+    struct intr_handler* handler;
+    unsigned long long count;
+} workQueue[INTR_WORK_QUEUE_SIZE];
+static volatile unsigned int workHead, workTail, workMaxDepth;
+static unsigned long long workQueued, workDropped;
+static sem_t workAvailable;
+static int workersRunning = 0;
+static int stopWorkers = 0;
+
 static int epollfd = -1;
 
 void toscaIntrInit () __attribute__((__constructor__));
@@ -62,6 +131,8 @@ void toscaIntrInit ()
     epollfd = epoll_create1(EPOLL_CLOEXEC);
     if (epollfd < 0)
         debugErrno("epoll_create");
+    if (sem_init(&workAvailable, 0, 0) != 0)
+        debugErrno("sem_init");
 }
 
 #define TOSCA_USER_INTR(n)        TOSCA_USER1_INTR(n)
@@ -107,6 +178,35 @@ void toscaIntrInit ()
         FOR_BITS_IN_MASK(0, 31, IX(USER, i), TOSCA_USER_INTR(i), (mask), action)        \
 }
 
+/* Returns the bits of bitmap word w which are selected by mask.
+   Word 0 holds USER1/USER2 (same bit order as in the mask),
+   words 1...56 hold the VME vectors, 8 words per level,
+   word 57 holds SYSFAIL, ACFAIL, ERROR.
+*/
+static inline uint32_t toscaIntrMaskWord(intrmask_t mask, unsigned int w)
+{
+    unsigned int ivec;
+
+    if (w == 0) return mask >> 32;
+    if (w > 7*8) return (mask >> 8) & 7;
+    if (!(mask & TOSCA_VME_INTR(((w-1)>>3)+1))) return 0;
+    ivec = TOSCA_INTR_MASK_TO_VEC(mask);
+    if (ivec == 0) return 0xffffffff; /* all vectors */
+    return (ivec>>5) == ((w-1)&7) ? 1U<<(ivec&31) : 0;
+}
+
+/* Like FOREACH_MASKBIT but only visits indices set in bitmap. */
+#define FOREACH_ACTIVE_MASKBIT(bitmap, mask, action)                                    \
+{                                                                                       \
+    unsigned int w, i;                                                                  \
+    uint32_t bits;                                                                      \
+    for (w = 0; w < INTR_BITMAP_WORDS; w++)                                             \
+        for (bits = bitmap[w] & toscaIntrMaskWord(mask, w); bits; bits &= bits-1) {     \
+            i = w*32 + __builtin_ctz(bits);                                             \
+            action(i, INTR_INDEX_TO_BIT(i))                                             \
+        }                                                                               \
+}
+
 const char* toscaIntrBitToStr(intrmask_t intrmaskbit)
 {
     switch(intrmaskbit & 0xffffffff0000ffffLL)
@@ -336,6 +436,7 @@ int toscaIntrMonitorFile(int index, const char* filepattern, ...)
         globfree(&globresults);
         return -1;
     } 
+    BITMAP_SET(intrMonitored, index);
     ev.events = EPOLLIN;
     ev.data.u32 = index;
     if (epoll_ctl(epollfd, EPOLL_CTL_ADD, intrFd[index], &ev) < 0)
@@ -348,15 +449,34 @@ int toscaIntrMonitorFile(int index, const char* filepattern, ...)
 }
 
 int toscaIntrConnectHandler(intrmask_t intrmask, void (*function)(), void* parameter)
+{
+    return toscaIntrConnectHandlerEx(intrmask, function, parameter, NULL);
+}
+
+int toscaIntrConnectHandlerEx(intrmask_t intrmask, void (*function)(), void* parameter, const toscaIntrOptions_t* options)
 {
     char* fname;
     unsigned int i;
     int status = 0;
     unsigned int device = TOSCA_INTR_MASK_TO_DEV(intrmask);
     unsigned int driverVersion;
+    uint64_t minInterval = 0, batchTime = 0;
+    unsigned int batchCount = 0, flags = 0;
 
     debug("intrmask=0x%016"PRIx64" device=%u, function=%s, parameter=%p",
         intrmask, device, fname=symbolName(function,0), parameter), free(fname);
+
+    if (options)
+    {
+        debug("maxRate=%u minInterval=%u batchCount=%u batchTime=%u flags=0x%x",
+            options->maxRate, options->minInterval, options->batchCount, options->batchTime, options->flags);
+        flags = options->flags;
+        minInterval = options->minInterval * 1000ULL;
+        if (options->maxRate && 1000000000ULL / options->maxRate > minInterval)
+            minInterval = 1000000000ULL / options->maxRate;
+        batchTime = options->batchTime * 1000ULL;
+        batchCount = options->batchCount;
+    }
         
     if (!function)
     {
@@ -453,11 +573,21 @@ int toscaIntrConnectHandler(intrmask_t intrmask, void (*function)(), void* param
         if (!(handler = calloc(1,sizeof(struct intr_handler)))) {                    \
             debugErrno("calloc"); status = -1; break; }                              \
         handler->device = device;                                                    \
+        handler->index = i;                                                          \
         handler->function = function;                                                \
         handler->parameter = parameter;                                              \
         handler->next = NULL;                                                        \
+        handler->flags = flags;                                                      \
+        if (minInterval || batchTime || batchCount) {                                \
+            handler->minInterval = minInterval;                                      \
+            handler->batchTime = batchTime;                                          \
+            handler->batchCount = batchCount;                                        \
+            do handler->nextModerated = moderatedHandlers;                           \
+            while (!__sync_bool_compare_and_swap(&moderatedHandlers,                 \
+                handler->nextModerated, handler)); }                                 \
         for (phandler = &handlers[i]; *phandler; phandler = &(*phandler)->next);     \
         *phandler = handler;                                                         \
+        BITMAP_SET(intrHandled, i);                                                  \
         debug("%u:%s ivec=%d: %s(%p)",                                               \
             device, toscaIntrBitToStr(bit), INTR_INDEX_TO_IVEC(i),                   \
             fname=symbolName(handler->function,0), handler->parameter), free(fname); \
@@ -487,14 +617,16 @@ int toscaIntrDisconnectHandler(intrmask_t intrmask, void (*function)(), void* pa
                 handler->function == function &&                   \
                 (!parameter || parameter == handler->parameter)) { \
                     *phandler = handler->next;                     \
+                    handler->removed = 1; /* unlinked later */     \
                     n++;                                           \
                     continue;                                      \
             }                                                      \
             phandler = &handler->next;                             \
         }                                                          \
+        if (!handlers[i]) BITMAP_CLEAR(intrHandled, i);            \
     }
     LOCK; /* do not free handler or we need to lock calling of handlers too */
-    FOREACH_MASKBIT(intrmask, REMOVE_HANDLER);
+    FOREACH_ACTIVE_MASKBIT(intrHandled, intrmask, REMOVE_HANDLER);
     UNLOCK;
     return n;
 }
@@ -509,6 +641,7 @@ int toscaIntrDisable(intrmask_t intrmask)
     ev.data.u32 = 0;
     #define DISABLE_INTR(i, bit)                                       \
     {                                                                  \
+        __sync_fetch_and_or(&intrDisabled[(i)>>5], 1U<<((i)&31));      \
         if (intrFd[i] > 0) {                                           \
             debug("disable %u:%s ivec=%u intrFd[%u]=%d",               \
                 device, toscaIntrIndexToStr(i),                        \
@@ -518,7 +651,7 @@ int toscaIntrDisable(intrmask_t intrmask)
                 debugErrno("epoll_ctl MOD %d", intrFd[i]);             \
         }                                                              \
     }
-    FOREACH_MASKBIT(intrmask, DISABLE_INTR);
+    FOREACH_ACTIVE_MASKBIT(intrMonitored, intrmask, DISABLE_INTR);
     return 0;
 }
 
@@ -531,6 +664,12 @@ int toscaIntrEnable(intrmask_t intrmask)
     ev.events = EPOLLIN;
     #define ENABLE_INTR(i, bit)                                        \
     {                                                                  \
+        __sync_fetch_and_and(&intrDisabled[(i)>>5], ~(1U<<((i)&31)));  \
+        if (intrFd[i] > 0 && BITMAP_TEST(intrGateMuted, i)) {          \
+            debug("enable %u:%s ivec=%u when gate is released",        \
+                device, toscaIntrIndexToStr(i),                        \
+                INTR_INDEX_TO_IVEC(i));                                \
+        } else                                                         \
         if (intrFd[i] > 0) {                                           \
             debug("enable %u:%s ivec=%u intrFd[%u]=%d",                \
                 device, toscaIntrIndexToStr(i),                        \
@@ -541,7 +680,7 @@ int toscaIntrEnable(intrmask_t intrmask)
                 debugErrno("epoll_ctl MOD %d", intrFd[i]);             \
         }                                                              \
     }
-    FOREACH_MASKBIT(intrmask, ENABLE_INTR);
+    FOREACH_ACTIVE_MASKBIT(intrMonitored, intrmask, ENABLE_INTR);
     return 0;
 }
 
@@ -566,7 +705,7 @@ size_t toscaIntrForEachHandler(size_t (*callback)(const toscaIntrHandlerInfo_t*,
             if (status != 0) return status;            \
         }                                              \
     }
-    FOREACH_MASKBIT(TOSCA_INTR_ANY, REPORT_HANDLER);
+    FOREACH_ACTIVE_MASKBIT(intrHandled, TOSCA_INTR_ANY, REPORT_HANDLER);
     return 0;
 }
 
@@ -575,12 +714,193 @@ unsigned long long toscaIntrCount()
     return totalIntrCount;
 }
 
+static uint64_t toscaIntrNow(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* Time when pending interrupts of a moderated handler are due */
+static uint64_t toscaIntrDeadline(const struct intr_handler* handler)
+{
+    uint64_t deadline = handler->lastCall + handler->minInterval;
+    if (handler->batchTime)
+    {
+        if (handler->firstPending + handler->batchTime > deadline)
+            deadline = handler->firstPending + handler->batchTime;
+    }
+    else if (handler->batchCount && !handler->minInterval)
+        return (uint64_t)-1; /* wait for batchCount only */
+    return deadline;
+}
+
+/* Called in the interrupt thread only */
+static void toscaIntrOffload(struct intr_handler* handler, unsigned long long count)
+{
+    unsigned int head = workHead;
+    unsigned int depth = head - workTail;
+
+    if (depth >= INTR_WORK_QUEUE_SIZE)
+    {
+        workDropped++;
+        debugLvl(1, "worker queue full, dropping call of handler for %s",
+            toscaIntrBitToStr(INTR_INDEX_TO_BIT(handler->index)));
+        return;
+    }
+    workQueue[head & (INTR_WORK_QUEUE_SIZE-1)].handler = handler;
+    workQueue[head & (INTR_WORK_QUEUE_SIZE-1)].count = count;
+    __sync_synchronize();
+    workHead = head + 1;
+    workQueued++;
+    if (++depth > workMaxDepth) workMaxDepth = depth;
+    sem_post(&workAvailable);
+}
+
+#define CALL_HANDLER(handler, inum, ivec, count)                   \
+    if (handler->flags & TOSCA_INTR_OFFLOAD && workersRunning)     \
+        toscaIntrOffload(handler, count);                          \
+    else                                                           \
+        handler->function(handler->parameter, inum, ivec, count)
+
+static void toscaIntrCallModerated(struct intr_handler* handler, uint64_t now)
+{
+    char* fname;
+    unsigned long long count = handler->pending;
+
+    handler->pending = 0;
+    handler->lastCall = now;
+    debugLvl(2, "index=%u %s, %llu coalesced %s(%p, %u, %u, %llu)",
+        handler->index,
+        toscaIntrBitToStr(INTR_INDEX_TO_BIT(handler->index)),
+        count,
+        fname=symbolName(handler->function,0),
+        handler->parameter, INTR_INDEX_TO_INUM(handler->index), INTR_INDEX_TO_IVEC(handler->index), count),
+        free(fname);
+    CALL_HANDLER(handler, INTR_INDEX_TO_INUM(handler->index), INTR_INDEX_TO_IVEC(handler->index), count);
+}
+
+/* Calls due moderated handlers and returns epoll timeout in ms until the next one is due.
+   Also unlinks removed handlers (only done here, in the interrupt thread). */
+static int toscaIntrFlushModerated(uint64_t now)
+{
+    struct intr_handler* handler, *prev = NULL;
+    uint64_t deadline, next = (uint64_t)-1;
+
+    for (handler = moderatedHandlers; handler; handler = handler->nextModerated)
+    {
+        if (handler->removed)
+        {
+            /* A new head may have been pushed meanwhile, then try again next time. */
+            if (prev)
+                prev->nextModerated = handler->nextModerated;
+            else if (!__sync_bool_compare_and_swap(&moderatedHandlers, handler, handler->nextModerated))
+                prev = handler;
+            continue;
+        }
+        prev = handler;
+        if (!handler->pending) continue;
+        deadline = toscaIntrDeadline(handler);
+        if (now >= deadline)
+            toscaIntrCallModerated(handler, now);
+        else if (deadline < next)
+            next = deadline;
+    }
+    if (next == (uint64_t)-1) return -1;
+    return (next - now + 999999) / 1000000;
+}
+
+int toscaIntrGateVmeLevel(unsigned int level, int hold)
+{
+    uint64_t e = 1;
+
+    if (level < 1 || level > 7)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (hold)
+    {
+        __sync_fetch_and_or(&vmeGated, 1 << level);
+        return 0;
+    }
+    __sync_fetch_and_and(&vmeGated, ~(1 << level));
+    __sync_synchronize();
+    if (vmeGatePending & (1 << level) && gateEvent >= 0)
+        write(gateEvent, &e, sizeof(e));
+    return 0;
+}
+
+/* Called in the interrupt thread only. Returns 1 if the interrupt has been held back. */
+static int toscaIntrGateHold(unsigned int index, unsigned int level)
+{
+    struct epoll_event ev;
+
+    __sync_fetch_and_or(&vmeGatePending, 1 << level);
+    __sync_synchronize();
+    if (!(vmeGated & (1 << level)))
+    {
+        /* released meanwhile */
+        if (!vmeGateMuted[level])
+            __sync_fetch_and_and(&vmeGatePending, ~(1 << level));
+        return 0;
+    }
+    debugLvl(2, "hold %s ivec=%u", toscaIntrIndexToStr(index), INTR_INDEX_TO_IVEC(index));
+    ev.events = 0;
+    ev.data.u32 = index;
+    if (epoll_ctl(epollfd, EPOLL_CTL_MOD, intrFd[index], &ev) < 0)
+        debugErrno("epoll_ctl MOD %d", intrFd[index]);
+    /* may already be muted if toscaIntrEnable came in between */
+    if (!BITMAP_TEST(intrGateMuted, index))
+    {
+        BITMAP_SET(intrGateMuted, index);
+        vmeGateMuted[level]++;
+    }
+    return 1;
+}
+
+/* Called in the interrupt thread only. Puts held interrupts of released levels back. */
+static void toscaIntrGateRelease(void)
+{
+    struct epoll_event ev;
+    unsigned int level;
+
+    /* toscaIntrEnable clears intrDisabled before it checks intrGateMuted */
+    #define UNMUTE_INTR(i, bit)                                        \
+    {                                                                  \
+        BITMAP_CLEAR(intrGateMuted, i);                                \
+        __sync_synchronize();                                          \
+        if (!BITMAP_TEST(intrDisabled, i)) {                           \
+            ev.events = EPOLLIN;                                       \
+            ev.data.u32 = i;                                           \
+            if (epoll_ctl(epollfd, EPOLL_CTL_MOD, intrFd[i], &ev) < 0) \
+                debugErrno("epoll_ctl MOD %d", intrFd[i]);             \
+            /* disabled meanwhile? */                                  \
+            __sync_synchronize();                                      \
+            if (BITMAP_TEST(intrDisabled, i)) {                        \
+                ev.events = 0;                                         \
+                epoll_ctl(epollfd, EPOLL_CTL_MOD, intrFd[i], &ev);     \
+            }                                                          \
+        }                                                              \
+    }
+    for (level = 1; level <= 7; level++)
+    {
+        if (!vmeGateMuted[level] || (vmeGated & (1 << level))) continue;
+        debugLvl(2, "release VME-%u, %u interrupts held", level, vmeGateMuted[level]);
+        FOREACH_ACTIVE_MASKBIT(intrGateMuted, TOSCA_VME_INTR(level), UNMUTE_INTR);
+        vmeGateMuted[level] = 0;
+        __sync_fetch_and_and(&vmeGatePending, ~(1 << level));
+    }
+}
+
 static int toscaIntrLoopRunning = 0;
 static int intrLoopStopEvent[2];
 
 void* toscaIntrLoop()
 {
-    unsigned int i, n, index, inum, ivec;
+    unsigned int i, index, inum, ivec;
+    int n, timeout = -1;
+    uint64_t now;
     
     /* handle up to 64 simultaneous interrupts in one system call */
     #define MAX_EVENTS 64
@@ -600,17 +920,30 @@ void* toscaIntrLoop()
     events[0].data.u32 = (uint32_t)-1;
     if (epoll_ctl(epollfd, EPOLL_CTL_ADD, intrLoopStopEvent[0], &events[0]) < 0)
         debugErrno("epoll_ctl ADD %d", intrLoopStopEvent[0]);
-    
+
+    gateEvent = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    events[0].events = EPOLLIN;
+    events[0].data.u32 = (uint32_t)-2;
+    if (gateEvent < 0)
+    {
+        debugErrno("eventfd");
+    }
+    else if (epoll_ctl(epollfd, EPOLL_CTL_ADD, gateEvent, &events[0]) < 0)
+        debugErrno("epoll_ctl ADD %d", gateEvent);
+    /* levels released before we had gateEvent */
+    toscaIntrGateRelease();
+
     while (toscaIntrLoopRunning)
     {
         debugLvl(2,"waiting for interrupts");
-        n = epoll_wait(epollfd, events, MAX_EVENTS, -1);
-        if (n < 1)
+        n = epoll_wait(epollfd, events, MAX_EVENTS, timeout);
+        if (n < 0)
         {
             if (errno == EINTR) continue;
             error("epoll_wait");
             break;
         }
+        now = moderatedHandlers ? toscaIntrNow() : 0;
         for (i = 0; i < n; i++)
         {
             struct intr_handler* handler;
@@ -624,13 +957,31 @@ void* toscaIntrLoop()
                 toscaIntrLoopRunning = 0;
                 break;
             }
+            if (index == (uint32_t)-2)
+            {
+                /* got gateEvent */
+                uint64_t e;
+                read(gateEvent, &e, sizeof(e));
+                toscaIntrGateRelease();
+                continue;
+            }
             inum = INTR_INDEX_TO_INUM(index);
             ivec = INTR_INDEX_TO_IVEC(index);
+            if (vmeGated && index >= IX(VME, 1, 0) && index < IX(ERR, 0) && toscaIntrGateHold(index, inum))
+                continue;
             totalIntrCount++;
             intrCount[index]++;
             debugLvl(2, "interrupt %llu index=%u inum=%u ivec=%u", totalIntrCount, index, inum, ivec);
             FOREACH_HANDLER(handler, index) {
                 char* fname;
+                if (handler->minInterval || handler->batchTime || handler->batchCount)
+                {
+                    if (handler->pending++ == 0) handler->firstPending = now;
+                    if ((handler->batchCount && handler->pending >= handler->batchCount) ||
+                        now >= toscaIntrDeadline(handler))
+                        toscaIntrCallModerated(handler, now);
+                    continue;
+                }
                 debugLvl(2, "index=%u fd=%d %s, #%llu %s(%p, %u, %u)",
                     index,
                     intrFd[index],
@@ -639,10 +990,23 @@ void* toscaIntrLoop()
                     fname=symbolName(handler->function,0),
                     handler->parameter, inum, ivec),
                     free(fname);
-                handler->function(handler->parameter, inum, ivec);
+                if (!(handler->flags & TOSCA_INTR_OFFLOAD))
+                    handler->function(handler->parameter, inum, ivec);
+                else if (workersRunning)
+                    toscaIntrOffload(handler, 1);
+                else
+                    handler->function(handler->parameter, inum, ivec, 1ULL);
             }
             write(intrFd[index], NULL, 0);  /* re-enable level interrupts (no-op for edge) */
         }
+        if (moderatedHandlers)
+            timeout = toscaIntrFlushModerated(toscaIntrNow());
+    }
+    if (gateEvent >= 0)
+    {
+        int fd = gateEvent;
+        gateEvent = -1;
+        close(fd);
     }
     debug("interrupt handling ended");
     return NULL;
@@ -661,6 +1025,250 @@ void toscaIntrLoopStop()
     while (toscaIntrLoopRunning) usleep(10);
 }
 
+void* toscaIntrWorkerLoop()
+{
+    struct intr_work work;
+    struct intr_handler* handler;
+    unsigned int tail;
+    int loopnumber;
+    char* fname;
+
+    loopnumber = __sync_fetch_and_add(&workersRunning, 1);
+    debug("interrupt worker %d started", loopnumber);
+    while (1)
+    {
+        if (sem_wait(&workAvailable) != 0)
+        {
+            if (errno == EINTR) continue;
+            error("sem_wait");
+            break;
+        }
+        if (stopWorkers) break;
+        do {
+            tail = workTail;
+            work = workQueue[tail & (INTR_WORK_QUEUE_SIZE-1)];
+        } while (!__sync_bool_compare_and_swap(&workTail, tail, tail + 1));
+        handler = work.handler;
+        if (handler->removed)
+        {
+            /* disconnected while queued */
+            debugLvl(2, "worker %d: skip removed handler", loopnumber);
+            continue;
+        }
+        debugLvl(2, "worker %d: %s %s(%p, %u, %u, %llu)",
+            loopnumber,
+            toscaIntrBitToStr(INTR_INDEX_TO_BIT(handler->index)),
+            fname=symbolName(handler->function,0),
+            handler->parameter, INTR_INDEX_TO_INUM(handler->index), INTR_INDEX_TO_IVEC(handler->index), work.count),
+            free(fname);
+        handler->function(handler->parameter, INTR_INDEX_TO_INUM(handler->index), INTR_INDEX_TO_IVEC(handler->index), work.count);
+    }
+    debug("interrupt worker %d stopped", loopnumber);
+    __sync_fetch_and_add(&workersRunning, -1);
+    return NULL;
+}
+
+int toscaIntrWorkersRunning(void)
+{
+    return workersRunning;
+}
+
+void toscaIntrWorkersStop()
+{
+    int i;
+    stopWorkers = 1;
+    debug("stopping interrupt workers");
+    for (i = workersRunning; i > 0; i--)
+        sem_post(&workAvailable);
+    while (workersRunning) usleep(10);
+    debug("interrupt workers stopped");
+}
+
+void toscaIntrGetWorkerStats(toscaIntrWorkerStats_t* stats)
+{
+    stats->size = INTR_WORK_QUEUE_SIZE;
+    stats->depth = workHead - workTail;
+    stats->maxDepth = workMaxDepth;
+    stats->queued = workQueued;
+    stats->dropped = workDropped;
+}
+
+/* Interrupt queues are single-producer (interrupt thread) / single-consumer ring buffers */
+struct toscaIntrQueue {
+    unsigned int size;  /* power of 2 */
+    volatile unsigned int head, tail;
+    unsigned long long overruns;
+    int fd;
+    intrmask_t intrmask;
+    toscaIntrEvent_t events[];
+};
+
+static void toscaIntrQueuePut(toscaIntrQueue_t* queue, intrmask_t intrmask, unsigned int inum, unsigned int ivec)
+{
+    unsigned int head = queue->head;
+    toscaIntrEvent_t* event;
+
+    if (head - queue->tail >= queue->size)
+    {
+        queue->overruns++;
+        debugLvl(1, "queue %p full, dropping %s", queue, toscaIntrBitToStr(intrmask));
+        return;
+    }
+    event = &queue->events[head & (queue->size-1)];
+    clock_gettime(CLOCK_REALTIME, &event->time);
+    event->intrmask = intrmask | (queue->intrmask & 0xff000000);
+    event->inum = inum;
+    event->ivec = ivec;
+    __sync_synchronize();
+    queue->head = ++head;
+    __sync_synchronize();
+    if (head - queue->tail == 1)
+    {
+        /* queue was empty, consumer may be waiting */
+        static const uint64_t one = 1;
+        write(queue->fd, &one, sizeof(one));
+    }
+}
+
+static void toscaIntrQueueUser(toscaIntrQueue_t* queue, unsigned int inum)
+{
+    toscaIntrQueuePut(queue, TOSCA_USER1_INTR(inum), inum, 0);
+}
+
+static void toscaIntrQueueVme(toscaIntrQueue_t* queue, unsigned int inum, unsigned int ivec)
+{
+    toscaIntrQueuePut(queue, TOSCA_VME_INTR_VEC(inum, ivec), inum, ivec);
+}
+
+static void toscaIntrQueueFail(toscaIntrQueue_t* queue, unsigned int inum)
+{
+    toscaIntrQueuePut(queue, TOSCA_VME_FAIL(inum), inum, 0);
+}
+
+toscaIntrQueue_t* toscaIntrQueueCreate(unsigned int size)
+{
+    toscaIntrQueue_t* queue;
+    unsigned int n = 1;
+
+    while (n < size) n <<= 1;
+    debug("size=%u -> %u", size, n);
+    queue = calloc(1, sizeof(toscaIntrQueue_t) + n * sizeof(toscaIntrEvent_t));
+    if (!queue)
+    {
+        debugErrno("calloc");
+        return NULL;
+    }
+    queue->size = n;
+    queue->fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (queue->fd < 0)
+    {
+        debugErrno("eventfd");
+        free(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+int toscaIntrQueueConnect(toscaIntrQueue_t* queue, intrmask_t intrmask)
+{
+    intrmask_t extra = intrmask & 0xffff0000ULL; /* device and vector */
+    int status = 0;
+
+    debug("queue=%p intrmask=0x%016"PRIx64, queue, intrmask);
+    if (!queue)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    queue->intrmask |= intrmask;
+    if (intrmask & TOSCA_USER_INTR_ANY)
+        status |= toscaIntrConnectHandler((intrmask & TOSCA_USER_INTR_ANY) | extra, toscaIntrQueueUser, queue);
+    if (intrmask & TOSCA_VME_INTR_ANY)
+        status |= toscaIntrConnectHandler((intrmask & TOSCA_VME_INTR_ANY) | extra, toscaIntrQueueVme, queue);
+    if (intrmask & TOSCA_VME_FAIL_ANY)
+        status |= toscaIntrConnectHandler((intrmask & TOSCA_VME_FAIL_ANY) | extra, toscaIntrQueueFail, queue);
+    return status;
+}
+
+int toscaIntrQueueDisconnect(toscaIntrQueue_t* queue, intrmask_t intrmask)
+{
+    intrmask_t extra = intrmask & 0xffff0000ULL; /* device and vector */
+
+    debug("queue=%p intrmask=0x%016"PRIx64, queue, intrmask);
+    if (!queue)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (intrmask & TOSCA_USER_INTR_ANY)
+        toscaIntrDisconnectHandler((intrmask & TOSCA_USER_INTR_ANY) | extra, toscaIntrQueueUser, queue);
+    if (intrmask & TOSCA_VME_INTR_ANY)
+        toscaIntrDisconnectHandler((intrmask & TOSCA_VME_INTR_ANY) | extra, toscaIntrQueueVme, queue);
+    if (intrmask & TOSCA_VME_FAIL_ANY)
+        toscaIntrDisconnectHandler((intrmask & TOSCA_VME_FAIL_ANY) | extra, toscaIntrQueueFail, queue);
+    return 0;
+}
+
+int toscaIntrWait(toscaIntrQueue_t* queue, int timeout)
+{
+    struct pollfd pfd;
+    uint64_t count;
+    int n;
+
+    pfd.fd = queue->fd;
+    pfd.events = POLLIN;
+    while (1)
+    {
+        __sync_synchronize();
+        if ((n = queue->head - queue->tail) != 0) return n;
+        n = poll(&pfd, 1, timeout);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            debugErrno("poll");
+            return -1;
+        }
+        if (n == 0) return 0; /* timeout */
+        read(queue->fd, &count, sizeof(count)); /* reset eventfd, may have been a stale event */
+    }
+}
+
+size_t toscaIntrQueueRead(toscaIntrQueue_t* queue, toscaIntrEvent_t* events, size_t max)
+{
+    unsigned int tail = queue->tail;
+    size_t n = queue->head - tail;
+
+    if (n > max) n = max;
+    __sync_synchronize();
+    for (max = 0; max < n; max++, tail++)
+        events[max] = queue->events[tail & (queue->size-1)];
+    __sync_synchronize();
+    queue->tail = tail;
+    return n;
+}
+
+int toscaIntrQueueFd(toscaIntrQueue_t* queue)
+{
+    return queue->fd;
+}
+
+unsigned long long toscaIntrQueueOverruns(toscaIntrQueue_t* queue)
+{
+    return queue->overruns;
+}
+
+void toscaIntrQueueDestroy(toscaIntrQueue_t* queue)
+{
+    int fd;
+
+    if (!queue) return;
+    toscaIntrQueueDisconnect(queue, (queue->intrmask & 0xff000000) | TOSCA_USER_INTR_ANY | TOSCA_VME_INTR_ANY | TOSCA_VME_FAIL_ANY);
+    fd = queue->fd;
+    queue->fd = -1;
+    close(fd);
+    /* Do not free queue, the interrupt thread may still use it (same as with handlers). */
+}
+
 int toscaSendVMEIntr(unsigned int level, unsigned int ivec)
 {
     unsigned int device = level >> 16;
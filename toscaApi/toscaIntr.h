@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -69,6 +70,24 @@ int toscaIntrConnectHandler(intrmask_t intrmask, void (*function)(), void* param
 /* Returns 0 on success. */
 /* The user function will be called with arguments (void* parameter, int inum, int ivec) */
 
+typedef struct {
+    unsigned int maxRate;      /* max number of handler calls per second, 0 means unlimited */
+    unsigned int minInterval;  /* min time between handler calls in microseconds */
+    unsigned int batchCount;   /* call handler when so many interrupts are pending... */
+    unsigned int batchTime;    /* ...or so many microseconds after the first pending interrupt */
+    unsigned int flags;        /* TOSCA_INTR_* flags below */
+} toscaIntrOptions_t;
+
+#define TOSCA_INTR_OFFLOAD 1   /* call handler in a worker thread, not in the interrupt thread */
+
+int toscaIntrConnectHandlerEx(intrmask_t intrmask, void (*function)(), void* parameter, const toscaIntrOptions_t* options);
+/* Like toscaIntrConnectHandler but with options. options may be NULL. */
+/* With any of the moderation options set, interrupts are coalesced. */
+/* The user function will be called with arguments (void* parameter, int inum, int ivec, unsigned long long count) */
+/* where count is the number of interrupts received since the previous call. */
+/* With the TOSCA_INTR_OFFLOAD flag, the handler is called (also with count) by a toscaIntrWorkerLoop thread. */
+/* If no worker is running, the handler is called in the interrupt thread. */
+
 int toscaIntrDisconnectHandler(intrmask_t intrmask, void (*function)(), void* parameter);
 /* Remark: Checks parameter only if it is not NULL. */
 /* Returns number of disconnected handlers. Thus 0 means: fail, there is not such handler. */
@@ -76,6 +95,13 @@ int toscaIntrDisconnectHandler(intrmask_t intrmask, void (*function)(), void* pa
 int toscaIntrDisable(intrmask_t intrmask);
 int toscaIntrEnable(intrmask_t intrmask);
 /* Temporarily suspends interrupt handling but keeps interrupts in queue. */
+/* Costs one system call per open interrupt file (up to 256 per VME level). */
+
+int toscaIntrGateVmeLevel(unsigned int level, int hold);
+/* Holds back (hold=1) or releases (hold=0) handling of VME interrupt level (1-7) of all devices. */
+/* Only flips a bit without system calls. Interrupts which arrive while held are kept in */
+/* queue (suspended like with toscaIntrDisable) and handled after release. */
+/* Returns 0 or -1 and sets errno. */
 
 void* toscaIntrLoop();
 /* Handles incoming interrupt and calls installed handlers. */
@@ -90,6 +116,28 @@ void toscaIntrLoopStop();
 /* Terminate the interrupt loop. */
 /* Returns after loop has stopped and no handler is active any more. */
 
+void* toscaIntrWorkerLoop();
+/* Calls handlers connected with TOSCA_INTR_OFFLOAD. */
+/* Start this function in one or more threads. */
+
+int toscaIntrWorkersRunning(void);
+/* Returns number of running worker loops. */
+
+void toscaIntrWorkersStop();
+/* Terminate all worker loops. */
+/* Returns after all loops have stopped. */
+
+typedef struct {
+    unsigned int size;             /* capacity of the hand-off queue */
+    unsigned int depth;            /* currently queued handler calls */
+    unsigned int maxDepth;         /* maximum depth seen */
+    unsigned long long queued;     /* total number of queued handler calls */
+    unsigned long long dropped;    /* handler calls dropped because the queue was full */
+} toscaIntrWorkerStats_t;
+
+void toscaIntrGetWorkerStats(toscaIntrWorkerStats_t* stats);
+/* Fills stats with the statistics of the worker hand-off queue. */
+
 typedef struct {
     intrmask_t intrmaskbit;    /* one of the mask bits */
     unsigned int device;       /* tosca device number */
@@ -100,6 +148,45 @@ typedef struct {
     unsigned long long count;  /* number of times the interrupt has been received */
 } toscaIntrHandlerInfo_t;
 
+/* Interrupt queues: an alternative to handler functions. */
+/* A consumer thread waits for and reads interrupt events from its own queue. */
+typedef struct toscaIntrQueue toscaIntrQueue_t;
+
+typedef struct {
+    intrmask_t intrmask;    /* single interrupt source bit including device and vector */
+    unsigned int inum;      /* as passed to handler functions */
+    unsigned int ivec;
+    struct timespec time;   /* CLOCK_REALTIME of interrupt dispatch */
+} toscaIntrEvent_t;
+
+toscaIntrQueue_t* toscaIntrQueueCreate(unsigned int size);
+/* Creates a queue for at least size events (rounded up to a power of 2). */
+/* Returns NULL on error and sets errno. */
+
+int toscaIntrQueueConnect(toscaIntrQueue_t* queue, intrmask_t intrmask);
+int toscaIntrQueueDisconnect(toscaIntrQueue_t* queue, intrmask_t intrmask);
+/* Adds or removes interrupt sources to or from the queue. */
+/* Returns 0 on success or -1 and sets errno. */
+
+int toscaIntrWait(toscaIntrQueue_t* queue, int timeout);
+/* Waits until events are in the queue or timeout (in ms, negative: forever) expired. */
+/* Returns the number of queued events, 0 on timeout or -1 on error and sets errno. */
+/* Does not do any system call if events are already queued. */
+
+size_t toscaIntrQueueRead(toscaIntrQueue_t* queue, toscaIntrEvent_t* events, size_t max);
+/* Removes up to max events from the queue without blocking. */
+/* Returns the number of events read. */
+
+int toscaIntrQueueFd(toscaIntrQueue_t* queue);
+/* Returns a file descriptor that becomes readable when events arrive in an empty queue. */
+/* Use for poll or select on multiple queues, then use toscaIntrWait(queue, 0) to reset. */
+
+unsigned long long toscaIntrQueueOverruns(toscaIntrQueue_t* queue);
+/* Returns the number of events lost because the queue was full. */
+
+void toscaIntrQueueDestroy(toscaIntrQueue_t* queue);
+/* Disconnects all interrupts and closes the queue. Do not use the queue any more afterwards. */
+
 size_t toscaIntrForEachHandler(size_t (*callback)(const toscaIntrHandlerInfo_t* info, void* user), void* user);
 /* Calls callback for each installed handler until a callback returns something else than 0. */
 /* Returns what the last callback had returned. */
@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <glob.h>
 #include <inttypes.h>
+#include <byteswap.h>
 
 #ifndef O_CLOEXEC
 #define O_CLOEXEC 02000000
@@ -29,6 +30,135 @@ typedef uint8_t __u8;
 #define TOSCA_DEBUG_NAME toscaMap
 #include "toscaDebug.h"
 
+/* Reading through a Tosca map is slow because each load is a non-posted PCIe read.
+ * Use as few and as wide loads as possible and issue several of them before using the data.
+ */
+
+int toscaMapReadAhead = 4;
+
+static inline uint64_t toscaSwap64(uint64_t v, unsigned int swap)
+{
+    switch (swap)
+    {
+        case 2:
+            return (v & 0x00ff00ff00ff00ffULL) << 8 | (v >> 8 & 0x00ff00ff00ff00ffULL);
+        case 4:
+            v = bswap_64(v);
+            return v << 32 | v >> 32;
+        case 8:
+            return bswap_64(v);
+        default:
+            return v;
+    }
+}
+
+static inline void toscaCopyElement(uint8_t* d, const volatile uint8_t* s, unsigned int swap)
+{
+    switch (swap)
+    {
+        case 2:
+        {
+            uint16_t v = bswap_16(*(const volatile uint16_t*)s);
+            memcpy(d, &v, 2);
+            break;
+        }
+        case 4:
+        {
+            uint32_t v = bswap_32(*(const volatile uint32_t*)s);
+            memcpy(d, &v, 4);
+            break;
+        }
+        case 8:
+        {
+            uint64_t v = bswap_64(*(const volatile uint64_t*)s);
+            memcpy(d, &v, 8);
+            break;
+        }
+    }
+}
+
+/* ahead is constant after inlining, thus v[] lives in registers */
+static inline void toscaCopyQwords(uint8_t* d, const volatile uint64_t* s, size_t n, unsigned int swap, const unsigned int ahead)
+{
+    uint64_t v[8];
+    unsigned int k;
+
+    while (n >= ahead)
+    {
+        for (k = 0; k < ahead; k++)
+            v[k] = s[k];
+        for (k = 0; k < ahead; k++)
+        {
+            v[k] = toscaSwap64(v[k], swap);
+            memcpy(d + 8*k, &v[k], 8);
+        }
+        s += ahead;
+        d += 8*ahead;
+        n -= ahead;
+    }
+    while (n--)
+    {
+        v[0] = toscaSwap64(*s++, swap);
+        memcpy(d, &v[0], 8);
+        d += 8;
+    }
+}
+
+void toscaMapCopyFrom(void* dest, const volatile void* source, size_t size, unsigned int swap)
+{
+    uint8_t* d = dest;
+    const volatile uint8_t* s = source;
+    size_t n;
+
+    debugLvl(3, "dest=%p source=%p size=0x%zx swap=%u readahead=%d", dest, source, size, swap, toscaMapReadAhead);
+    if (swap != 2 && swap != 4 && swap != 8) swap = 0;
+
+    /* head: smaller loads until source is 8 byte aligned */
+    if (swap)
+        for (; ((size_t)s & 7) && size >= swap; s += swap, d += swap, size -= swap)
+            toscaCopyElement(d, s, swap);
+    else
+    {
+        if ((size_t)s & 1 && size >= 1) { *d++ = *s++; size--; }
+        if ((size_t)s & 2 && size >= 2) { uint16_t v = *(const volatile uint16_t*)s; memcpy(d, &v, 2); s += 2; d += 2; size -= 2; }
+        if ((size_t)s & 4 && size >= 4) { uint32_t v = *(const volatile uint32_t*)s; memcpy(d, &v, 4); s += 4; d += 4; size -= 4; }
+    }
+
+    /* body: 64 bit loads */
+    if (!((size_t)s & 7))
+    {
+        n = size / 8;
+        switch (toscaMapReadAhead)
+        {
+            case 8:
+                toscaCopyQwords(d, (const volatile uint64_t*)s, n, swap, 8);
+                break;
+            case 4:
+                toscaCopyQwords(d, (const volatile uint64_t*)s, n, swap, 4);
+                break;
+            case 2:
+                toscaCopyQwords(d, (const volatile uint64_t*)s, n, swap, 2);
+                break;
+            default:
+                toscaCopyQwords(d, (const volatile uint64_t*)s, n, swap, 1);
+        }
+        s += n*8;
+        d += n*8;
+        size -= n*8;
+    }
+
+    /* tail */
+    if (swap)
+        for (; size >= swap; s += swap, d += swap, size -= swap)
+            toscaCopyElement(d, s, swap);
+    else
+    {
+        if (size >= 4) { uint32_t v = *(const volatile uint32_t*)s; memcpy(d, &v, 4); s += 4; d += 4; size -= 4; }
+        if (size >= 2) { uint16_t v = *(const volatile uint16_t*)s; memcpy(d, &v, 2); s += 2; d += 2; size -= 2; }
+    }
+    while (size--) *d++ = *s++;
+}
+
 /* Tosca tries to re-use mapping windows if possible.
  * Unfortunately mmap does not re-use mappings.
  * We need to keep our own list.
@@ -60,6 +60,13 @@ volatile void* toscaMap(unsigned int addrspace, uint64_t address, size_t size, u
    At the moment, Tosca does not support A64 but maybe one day?
 */
 
+extern int toscaMapReadAhead;
+void toscaMapCopyFrom(void* dest, const volatile void* source, size_t size, unsigned int swap);
+/* Copies size bytes from a Tosca map (or any memory) to dest using the widest possible loads. */
+/* Reads toscaMapReadAhead (1, 2, 4 or 8, default 4) 64 bit words before storing them to dest. */
+/* With swap = 2, 4 or 8 bytes are swapped in elements of this size (in registers, source must be aligned to swap). */
+/* Do not use on registers which do not allow wide or combined access. */
+
 /* Several map lookup functions. addrspace will be 0 if map is not found. */
 typedef struct {
     uint64_t baseaddress;
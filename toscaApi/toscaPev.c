@@ -8,14 +8,12 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <signal.h>
-#include <sys/select.h>
 #include <endian.h>
 #include <malloc.h>
 
 #ifndef O_CLOEXEC
 #define O_CLOEXEC 02000000
 #define open(path,flags) ({int _fd=open(path,(flags)&~O_CLOEXEC); if ((flags)&O_CLOEXEC) fcntl(_fd, F_SETFD, fcntl(_fd, F_GETFD)|FD_CLOEXEC); _fd; })
-#define pipe2(fds,flags) ({int _st=pipe(fds); fcntl(fds[0], F_SETFD, fcntl(fds[0], F_GETFD) | FD_CLOEXEC); fcntl(fds[1], F_SETFD, fcntl(fds[1], F_GETFD)|FD_CLOEXEC); _st; })
 #endif
 
 #include "toscaPev.h"
@@ -153,6 +151,70 @@ int pev_elb_wr(int address, int value)
     return pevx_elb_wr(defaultCrate, address, value);
 }
 
+int pevx_elb_handle(uint crate, int address, pevElbHandle* handle)
+{
+    debug("crate=%u address=0x%x", crate, address);
+    if (crate != 0)
+    {
+        debug("can only access crate 0");
+        errno = ENODEV;
+        return -1;
+    }
+    handle->address = address;
+    handle->swap = 0;
+    if (address >= 0xe000) /* sram */
+        handle->ptr = sramPtr(address - 0xe000);
+    else
+        handle->ptr = toscaPonRegPtr(address, &handle->swap);
+    return handle->ptr || errno == 0 ? 0 : -1;
+}
+
+int pev_elb_handle_wr(const pevElbHandle* handle, int value)
+{
+    if (handle->address >= 0xe000)
+    {
+        *handle->ptr = value;
+        return 0;
+    }
+    /* PON writes may need read-modify-write protection */
+    return toscaPonWrite(handle->address, value);
+}
+
+int pevx_elb_rd_block(uint crate, int address, unsigned int count, int values[])
+{
+    unsigned int addresses[0x44/4];
+    unsigned int i;
+
+    debug("crate=%u address=0x%x count=%u", crate, address, count);
+    if (crate != 0)
+    {
+        debug("can only access crate 0");
+        errno = ENODEV;
+        return -1;
+    }
+    if (address >= 0xe000) /* sram */
+    {
+        volatile uint32_t* ptr = sramPtr(address - 0xe000);
+        if (!ptr) return -1;
+        if (address - 0xe000 + count * 4 > 0x2000)
+        {
+            errno = EFAULT;
+            return -1;
+        }
+        for (i = 0; i < count; i++)
+            values[i] = ptr[i];
+        return 0;
+    }
+    if (count > sizeof(addresses)/sizeof(addresses[0]))
+    {
+        errno = EFAULT;
+        return -1;
+    }
+    for (i = 0; i < count; i++)
+        addresses[i] = address + i * 4;
+    return toscaPonReadList(count, addresses, (unsigned int*)values);
+}
+
 /** SMON **************************************************/
 
 int pev_smon_rd(int address)
@@ -370,7 +432,7 @@ int pev_map_modify(struct pev_ioctl_map_pg *map_p)
 /** INTR **************************************************/
 
 typedef struct {
-    int fd[2];
+    toscaIntrQueue_t* queue;
     int enabled;
     intrmask_t mask;
 } my_pev_evt_queue;
@@ -380,9 +442,15 @@ struct pev_ioctl_evt *pevx_evt_queue_alloc(uint crate, int sig)
     struct pev_ioctl_evt *evt;
     if (crate > 0) return NULL;
     evt = calloc(1, sizeof(struct pev_ioctl_evt) + sizeof(my_pev_evt_queue));
+    if (!evt) return NULL;
     evt->sig = sig;
     evt->evt_queue = evt + 1;
-    pipe2(((my_pev_evt_queue*)evt->evt_queue)->fd, O_NONBLOCK|O_CLOEXEC);
+    ((my_pev_evt_queue*)evt->evt_queue)->queue = toscaIntrQueueCreate(256);
+    if (!((my_pev_evt_queue*)evt->evt_queue)->queue)
+    {
+        free(evt);
+        return NULL;
+    }
     return evt;
 }
 
@@ -391,26 +459,25 @@ struct pev_ioctl_evt *pev_evt_queue_alloc(int sig)
     return pevx_evt_queue_alloc(defaultCrate, sig);
 }
 
-static void pev_intr_vme(struct pev_ioctl_evt *evt, int inum, int vec)
+/* called after the event has been queued */
+static void pev_intr_sig(struct pev_ioctl_evt *evt)
+{
+    debug("sig=%i", evt->sig);
+    kill(getpid(), evt->sig);
+}
+
+static void pev_evt_connect(struct pev_ioctl_evt *evt, intrmask_t mask)
 {
     my_pev_evt_queue *q = (my_pev_evt_queue*)evt->evt_queue;
-    debug("inum=%i vec=%i enabled=%i", inum, vec, q->enabled);
-    if (!q->enabled) return;
-    uint16_t ev = (EVT_SRC_VME | inum) << 8 | vec;
-    debug("ev=0x%04x sig=%i", ev, evt->sig);
-    write(q->fd[1], &ev, 2);
-    if (evt->sig) kill(getpid(), evt->sig);
+    toscaIntrQueueConnect(q->queue, mask);
+    if (evt->sig) toscaIntrConnectHandler(mask, pev_intr_sig, evt);
 }
 
-static void pev_intr_usr(struct pev_ioctl_evt *evt, int inum)
+static void pev_evt_disconnect(struct pev_ioctl_evt *evt, intrmask_t mask)
 {
     my_pev_evt_queue *q = (my_pev_evt_queue*)evt->evt_queue;
-    debug("inum=%i enabled=%i", inum, q->enabled);
-    if (!q->enabled) return;
-    uint16_t ev = (EVT_SRC_USR1 | inum) << 8;
-    debug("ev=0x%04x sig=%i", ev, evt->sig);
-    write(q->fd[1], &ev, 2);
-    if (evt->sig) kill(getpid(), evt->sig);
+    toscaIntrQueueDisconnect(q->queue, mask);
+    if (evt->sig) toscaIntrDisconnectHandler(mask, pev_intr_sig, evt);
 }
 
 int pevx_evt_register(uint crate, struct pev_ioctl_evt *evt, int src_id)
@@ -427,16 +494,15 @@ int pevx_evt_register(uint crate, struct pev_ioctl_evt *evt, int src_id)
         case EVT_SRC_VME:
             mask = TOSCA_VME_INTR(src_id & 0xf);
             if (q->mask & mask & TOSCA_VME_INTR_ANY) return -1;
-            toscaIntrConnectHandler(mask, pev_intr_vme, evt);
             break;
         case EVT_SRC_USR1:
         case EVT_SRC_USR2:
             mask = TOSCA_USER1_INTR(src_id & 0x1f);
             if (q->mask & mask) return -1;
-            toscaIntrConnectHandler(mask, pev_intr_usr, evt);
             break;
         default: return -1;
     }
+    if (q->enabled) pev_evt_connect(evt, mask);
     q->mask |= mask;
     return 0;
 }
@@ -449,11 +515,9 @@ int pev_evt_register(struct pev_ioctl_evt *evt, int src_id)
 int pevx_evt_queue_free(uint crate __attribute__((unused)), struct pev_ioctl_evt *evt)
 {
     my_pev_evt_queue *q = (my_pev_evt_queue*)evt->evt_queue;
+    if (q->enabled) pev_evt_disconnect(evt, q->mask);
     q->enabled = 0;
-    toscaIntrDisconnectHandler(TOSCA_VME_INTR_ANY, pev_intr_vme, evt);
-    toscaIntrDisconnectHandler(TOSCA_USER_INTR_ANY, pev_intr_usr, evt);
-    close(q->fd[0]);
-    close(q->fd[1]);
+    toscaIntrQueueDestroy(q->queue);
     free(evt);
     return 0;
 }
@@ -465,36 +529,24 @@ int pev_evt_queue_free(struct pev_ioctl_evt *evt)
 
 int pevx_evt_read(uint crate __attribute__((unused)), struct pev_ioctl_evt *evt, int timeout)
 {
-    int fd = ((my_pev_evt_queue*)evt->evt_queue)->fd[0];
+    toscaIntrQueue_t* queue = ((my_pev_evt_queue*)evt->evt_queue)->queue;
+    toscaIntrEvent_t event;
     uint16_t ev;
 
     if (timeout)
     {
-        fd_set read_fs;
-        struct timeval tv;
-        int n;
-
-        FD_ZERO(&read_fs);
-        FD_SET(fd, &read_fs);
-        if (timeout > 0)
+        if (toscaIntrWait(queue, timeout) < 1)
         {
-            tv.tv_sec = timeout/1000;
-            tv.tv_usec = (timeout%1000)*1000;
-        }
-        n = select(fd + 1, &read_fs, NULL, NULL, timeout > 0 ? &tv : NULL);
-        if (n < 1)
-        {
-            debugErrno("crate=%d select", crate);
+            debugErrno("crate=%d toscaIntrWait", crate);
             return -1 << 8;
         }
     }
-    if (read(fd, &ev, 2) < 0) /* non-blocking */
-    {
-        if (errno == EWOULDBLOCK)
-            return 0;
-        else
-            return -1 << 8;
-    }
+    if (toscaIntrQueueRead(queue, &event, 1) == 0)
+        return 0;
+    if (event.intrmask & TOSCA_VME_INTR_ANY)
+        ev = (EVT_SRC_VME | event.inum) << 8 | event.ivec;
+    else
+        ev = (EVT_SRC_USR1 | event.inum) << 8;
     debug("crate=%d ev=0x%04x", crate, ev);
     return ev;
 }
@@ -507,6 +559,7 @@ int pev_evt_read(struct pev_ioctl_evt *evt, int timeout)
 int pevx_evt_queue_enable(uint crate __attribute__((unused)), struct pev_ioctl_evt *evt)
 {
     my_pev_evt_queue *q = (my_pev_evt_queue*)evt->evt_queue;
+    if (!q->enabled) pev_evt_connect(evt, q->mask);
     q->enabled = 1;
     return 0;
 }
@@ -519,6 +572,7 @@ int pev_evt_queue_enable(struct pev_ioctl_evt *evt)
 int pevx_evt_queue_disable(uint crate __attribute__((unused)), struct pev_ioctl_evt *evt)
 {
     my_pev_evt_queue *q = (my_pev_evt_queue*)evt->evt_queue;
+    if (q->enabled) pev_evt_disconnect(evt, q->mask);
     q->enabled = 0;
     return 0;
 }
@@ -2,9 +2,12 @@
 #define toscaPev_h
 
 #include <stddef.h>
+#include <stdint.h>
+#include <byteswap.h>
 #include <pevioctl.h>
 #include <pevulib.h>
 #include <pevxulib.h>
+#include "toscaReg.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,6 +24,28 @@ volatile void* pevMapExt(unsigned int card, unsigned int sg_id, unsigned int map
     pevMapExt((card), (sg_id), (map_mode), (logicalAddress), (size), MAP_FLAG_FORCE, (localAddress))
 
 
+/* ELB access handle resolved once for repeated access to one PON register or SRAM word (address >= 0xe000) */
+typedef struct {
+    volatile uint32_t* ptr;   /* SRAM or mapped PON register, NULL: PON through sysfs */
+    int swap;
+    int address;
+} pevElbHandle;
+
+int pevx_elb_handle(uint crate, int address, pevElbHandle* handle);
+/* Returns 0 or -1 and sets errno. */
+
+static inline int pev_elb_handle_rd(const pevElbHandle* handle)
+{
+    if (handle->ptr) return handle->swap ? (int)bswap_32(*handle->ptr) : (int)*handle->ptr;
+    return toscaPonRead(handle->address);
+}
+
+int pev_elb_handle_wr(const pevElbHandle* handle, int value);
+
+int pevx_elb_rd_block(uint crate, int address, unsigned int count, int values[]);
+/* Reads count consecutive 32 bit ELB words in one pass. */
+/* Returns 0 or -1 and sets errno. */
+
 #define EVT_SRC_VME_ANY_LEVEL ((EVT_SRC_VME+1)|((EVT_SRC_VME+7)<<8))
 
 int pevIntrConnect(unsigned int card, unsigned int src_id, unsigned int vec_id, void (*func)(), void* usr);
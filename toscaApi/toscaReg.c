@@ -1,5 +1,14 @@
 #include <pthread.h>
 #include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <byteswap.h>
+#include <time.h>
 
 #include <endian.h>
 #ifndef le32toh
@@ -86,6 +95,15 @@ unsigned int toscaWrite(unsigned int addrspace, unsigned int address, unsigned i
     return le32toh(*ptr);
 }
 
+int toscaWritePosted(unsigned int addrspace, unsigned int address, unsigned int value)
+{
+    volatile uint32_t* ptr = toscaMap(addrspace, address, 4, 0);
+    debug("address=0x%02x value=0x%x ptr=%p", address, value, ptr);
+    if (!ptr) return -1;
+    *ptr = htole32(value);
+    return 0;
+}
+
 unsigned int toscaSet(unsigned int addrspace, unsigned int address, unsigned int bitsToSet)
 {
     errno = 0;
@@ -130,6 +148,25 @@ unsigned int toscaSmonRead(unsigned int address)
     return value;
 }
 
+int toscaSmonReadList(unsigned int device, unsigned int count, const unsigned int addresses[], unsigned int values[])
+{
+    unsigned int i;
+    volatile uint32_t* ptr = toscaMap((device<<16)|TOSCA_CSR, CSR_SMON_REG, 12, 0);
+    debug("device=%u count=%u ptr=%p", device, count, ptr);
+    if (!ptr) return -1;
+    for (i = 0; i < count; i++)
+        if (addresses[i] >= 0x80) { errno = EINVAL; return -1; }
+    pthread_mutex_lock(&smon_mutex);
+    for (i = 0; i < count; i++)
+    {
+        ptr[0] = htole32(addresses[i]);
+        (void) ptr[0]; /* read back to flush write */
+        values[i] = le32toh(ptr[1]);
+    }
+    pthread_mutex_unlock(&smon_mutex);
+    return 0;
+}
+
 unsigned int toscaSmonWriteMasked(unsigned int address, unsigned int mask, unsigned int value)
 {
     errno = 0;
@@ -203,19 +240,25 @@ const char* toscaPonAddrToRegname(unsigned int address)
     }
 };
 
-int toscaPonFd(unsigned int address)
+static int toscaPonCheckAddr(unsigned int address)
 {
-    static int fd[11] = {0};
-    unsigned int reg;
-    
-    address &= ~3;
-    if (address >= 0x28 && address != 0x40)
+    if ((address & ~3) >= 0x28 && (address & ~3) != 0x40)
     {
         debug("address=0x%x -- not implemented", address);
         errno = EINVAL;
         return -1;
     }
-    if (address == 40) reg = 10;
+    return 0;
+}
+
+int toscaPonFd(unsigned int address)
+{
+    static int fd[11] = {0};
+    unsigned int reg;
+    
+    address &= ~3;
+    if (toscaPonCheckAddr(address) != 0) return -1;
+    if (address == 0x40) reg = 10;
     else reg = address>>2;
     if (!fd[reg])
     {
@@ -227,29 +270,199 @@ int toscaPonFd(unsigned int address)
     return fd[reg];
 }
 
+/* Direct access:
+   If the platform exposes the PON registers on the ELB as UIO device
+   (like the SRAM), map them and avoid one sysfs syscall with text
+   conversion per register. The byte order is found by comparing the
+   signature register with the sysfs value. Without UIO device (or if
+   the signature does not match) all access goes through sysfs.
+*/
+
+int toscaPonDirect = 1;
+
+static volatile uint32_t* toscaPonPtr;
+static int toscaPonSwap;
+static pthread_mutex_t pon_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t pon_once = PTHREAD_ONCE_INIT;
+
+static void toscaPonMapInit(void)
+{
+    glob_t globresults;
+    char filename[80];
+    char buffer[24];
+    char* uiodev;
+    size_t mapsize;
+    ssize_t n;
+    int fd;
+    void* ptr;
+    unsigned int signature, value;
+
+    sprintf(filename, "/sys/devices/{,*/}*localbus/*.pon/uio/uio*/maps/map0/size");
+    if (glob(filename, GLOB_BRACE, NULL, &globresults) != 0)
+    {
+        debug("no PON UIO device, using sysfs");
+        return;
+    }
+    fd = open(globresults.gl_pathv[0], O_RDONLY|O_CLOEXEC);
+    if (fd < 0)
+    {
+        debugErrno("open %s", globresults.gl_pathv[0]);
+        globfree(&globresults);
+        return;
+    }
+    n = read(fd, buffer, sizeof(buffer)-1);
+    close(fd);
+    if (n <= 0)
+    {
+        debugErrno("read %s", globresults.gl_pathv[0]);
+        globfree(&globresults);
+        return;
+    }
+    buffer[n] = 0;
+    mapsize = strtoul(buffer, NULL, 0);
+    uiodev = strstr(globresults.gl_pathv[0], "/uio/") + 5;
+    *strchr(uiodev, '/') = 0;
+    sprintf(filename, "/dev/%s", uiodev);
+    globfree(&globresults);
+    if (mapsize < 0x44)
+    {
+        debug("%s size 0x%zx too small", filename, mapsize);
+        return;
+    }
+    fd = open(filename, O_RDWR|O_CLOEXEC);
+    if (fd < 0)
+    {
+        debugErrno("open %s", filename);
+        return;
+    }
+    ptr = mmap(NULL, mapsize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+    {
+        debugErrno("mmap %s", filename);
+        return;
+    }
+    signature = sysfsReadULong(toscaPonFd(0x1c));
+    value = ((volatile uint32_t*)ptr)[0x1c>>2];
+    if (value == signature)
+        toscaPonSwap = 0;
+    else if (bswap_32(value) == signature)
+        toscaPonSwap = 1;
+    else
+    {
+        debug("%s signature 0x%08x does not match sysfs 0x%08x, using sysfs", filename, value, signature);
+        munmap(ptr, mapsize);
+        return;
+    }
+    debug("mapped PON registers from %s%s", filename, toscaPonSwap ? " (swapped)" : "");
+    toscaPonPtr = ptr;
+}
+
+static volatile uint32_t* toscaPonMap(void)
+{
+    if (!toscaPonDirect) return NULL;
+    pthread_once(&pon_once, toscaPonMapInit);
+    return toscaPonPtr;
+}
+
+int toscaPonDirectAccess(void)
+{
+    return toscaPonMap() != NULL;
+}
+
+volatile uint32_t* toscaPonRegPtr(unsigned int address, int* swap)
+{
+    volatile uint32_t* pon;
+
+    if (toscaPonCheckAddr(address) != 0) return NULL;
+    if ((pon = toscaPonMap()) == NULL)
+    {
+        /* not mapped is no error, the mapping attempt may have left errno set */
+        errno = 0;
+        return NULL;
+    }
+    *swap = toscaPonSwap;
+    return pon + (address >> 2);
+}
+
+static inline unsigned int toscaPonGet(volatile uint32_t* pon, unsigned int address)
+{
+    uint32_t value = pon[address>>2];
+    return toscaPonSwap ? bswap_32(value) : value;
+}
+
+static inline void toscaPonPut(volatile uint32_t* pon, unsigned int address, unsigned int value)
+{
+    pon[address>>2] = toscaPonSwap ? bswap_32(value) : value;
+}
+
 unsigned int toscaPonRead(unsigned int address)
 {
+    volatile uint32_t* pon;
     debug("address=0x%02x", address);
+    if ((pon = toscaPonMap()) != NULL)
+    {
+        if (toscaPonCheckAddr(address) != 0) return (unsigned int)-1;
+        errno = 0;
+        return toscaPonGet(pon, address & ~3);
+    }
     int fd = toscaPonFd(address);
     if (fd < 0) return (unsigned int)-1;
     return sysfsReadULong(fd);
 }
 
+int toscaPonReadList(unsigned int count, const unsigned int addresses[], unsigned int values[])
+{
+    volatile uint32_t* pon;
+    unsigned int i;
+
+    debug("count=%u", count);
+    for (i = 0; i < count; i++)
+        if (toscaPonCheckAddr(addresses[i]) != 0) return -1;
+    if ((pon = toscaPonMap()) != NULL)
+    {
+        for (i = 0; i < count; i++)
+            values[i] = toscaPonGet(pon, addresses[i] & ~3);
+        return 0;
+    }
+    for (i = 0; i < count; i++)
+    {
+        int fd = toscaPonFd(addresses[i]);
+        if (fd < 0) return -1;
+        errno = 0;
+        values[i] = sysfsReadULong(fd);
+        if (values[i] == (unsigned int)-1 && errno) return -1;
+    }
+    return 0;
+}
+
 unsigned int toscaPonWrite(unsigned int address, unsigned int value)
 {
-    debug("address=0x%02x value=0x%x", address, value);
-    int fd = toscaPonFd(address);
-    if (fd < 0) return (unsigned int)-1;
-    sysfsWrite(fd, "%x", value);
-    return sysfsReadULong(fd);
+    return toscaPonWriteMasked(address, 0xffffffff, value);
 }
 
 unsigned int toscaPonWriteMasked(unsigned int address, unsigned int mask, unsigned int value)
 {
-    debug("address=0x%02x value=0x%x", address, value);
+    volatile uint32_t* pon;
+    debug("address=0x%02x mask=0x%x value=0x%x", address, mask, value);
+    if ((pon = toscaPonMap()) != NULL)
+    {
+        if (toscaPonCheckAddr(address) != 0) return (unsigned int)-1;
+        address &= ~3;
+        errno = 0;
+        pthread_mutex_lock(&pon_mutex);
+        if (mask != 0xffffffff)
+            value = (value & mask) | (toscaPonGet(pon, address) & ~mask);
+        toscaPonPut(pon, address, value);
+        value = toscaPonGet(pon, address); /* read back to flush write */
+        pthread_mutex_unlock(&pon_mutex);
+        return value;
+    }
     int fd = toscaPonFd(address);
     if (fd < 0) return (unsigned int)-1;
-    sysfsWrite(fd, "%x", (value & mask) | (sysfsReadULong(fd) & ~mask));
+    if (mask != 0xffffffff)
+        value = (value & mask) | (sysfsReadULong(fd) & ~mask);
+    sysfsWrite(fd, "%x", value);
     return sysfsReadULong(fd);
 }
 
@@ -270,51 +483,173 @@ unsigned int toscaPonClear(unsigned int address, unsigned int bitsToClear)
 #define CSR_SERIAL_BUS_CONTROLER 0x120c /* 2 regs: address and value */
 #define FMC_MAX 2
 
-unsigned int toscaSbcWriteMasked(unsigned int fmc, unsigned int reg, unsigned int mask, unsigned int value)
+#define SBC_READ    0x08000000
+#define SBC_WRITE   0x0c000000
+#define SBC_BUSY    0x80000000
+#define SBC_SPIN    50          /* polls before sleeping */
+#define SBC_TIMEOUT 10000000    /* ns */
+#define SBC_CHUNK   16          /* registers per lock hold */
+
+/* One entry per Tosca device, created on first use */
+struct toscaSbc
 {
-    static pthread_mutex_t sbc_mutex[FMC_MAX] = {PTHREAD_MUTEX_INITIALIZER,PTHREAD_MUTEX_INITIALIZER};
-    static volatile uint32_t* csr = (void*)-1;
-    int tries_left = 1000;
-    int addr;
+    volatile uint32_t* csr;
+    pthread_mutex_t lock[FMC_MAX];
+};
+static struct toscaSbc* toscaSbcs;
+static pthread_mutex_t sbc_init_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-    if (fmc-1 >= FMC_MAX)
+/* Sets *cmd to the address/command register of the SBC (the value register follows)
+   and returns the lock of the slot.
+*/
+static pthread_mutex_t* toscaSbcCmd(unsigned int fmc_slot, volatile uint32_t** cmd)
+{
+    unsigned int device = fmc_slot >> 16;
+    unsigned int fmc = fmc_slot & 0xffff;
+    unsigned int devs = toscaNumDevices();
+    struct toscaSbc* sbc;
+
+    /* default is the device with the FMC slots */
+    if (device == 0) device = toscaDeviceType(0) == 0x1211 ? 1 : 0;
+    else device--;
+    if (fmc-1 >= FMC_MAX || device >= devs)
     {
         errno = ENODEV;
-        return -1;
+        return NULL;
+    }
+    if (!toscaSbcs)
+    {
+        pthread_mutex_lock(&sbc_init_mutex);
+        if (!toscaSbcs)
+        {
+            struct toscaSbc* sbcs = calloc(devs, sizeof(struct toscaSbc));
+            unsigned int d, f;
+            if (sbcs)
+            {
+                for (d = 0; d < devs; d++)
+                    for (f = 0; f < FMC_MAX; f++)
+                        pthread_mutex_init(&sbcs[d].lock[f], NULL);
+                __sync_synchronize();
+                toscaSbcs = sbcs;
+            }
+        }
+        pthread_mutex_unlock(&sbc_init_mutex);
+        if (!toscaSbcs) return NULL;
+    }
+    sbc = &toscaSbcs[device];
+    if (!sbc->csr)
+    {
+        /* toscaMap returns the same map each time, thus a race here is harmless */
+        volatile uint32_t* csr = toscaMap((device<<16)|TOSCA_CSR, 0, 0, 0);
+        if (!csr) return NULL;
+        sbc->csr = csr;
+    }
+    *cmd = sbc->csr + (CSR_SERIAL_BUS_CONTROLER + (fmc-1) * 0x100)/4;
+    return &sbc->lock[fmc-1];
+}
+
+/* A command usually completes within a few polls.
+   If not, sleep with increasing delay instead of burning CPU.
+*/
+static int toscaSbcWait(volatile uint32_t* cmd)
+{
+    struct timespec delay = {0, 1000};
+    long waited = 0;
+    int i;
+
+    for (i = 0; i < SBC_SPIN; i++)
+        if (!(le32toh(*cmd) & SBC_BUSY)) return 0;
+    while (waited < SBC_TIMEOUT)
+    {
+        nanosleep(&delay, NULL);
+        waited += delay.tv_nsec;
+        if (!(le32toh(*cmd) & SBC_BUSY)) return 0;
+        if (delay.tv_nsec < 1000000) delay.tv_nsec *= 2;
+    }
+    debug("timeout cmd=0x%x", le32toh(*cmd));
+    errno = EIO;
+    return -1;
+}
+
+int toscaSbcReadBlock(unsigned int fmc, unsigned int reg, unsigned int count, unsigned int values[])
+{
+    volatile uint32_t* cmd;
+    pthread_mutex_t* lock;
+    unsigned int i = 0, n;
+    int status = 0;
+
+    errno = 0;
+    if (!(lock = toscaSbcCmd(fmc, &cmd))) return -1;
+    debug("fmc=0x%x, reg=0x%x, count=%u", fmc, reg, count);
+    while (i < count && status == 0)
+    {
+        n = i + SBC_CHUNK < count ? i + SBC_CHUNK : count;
+        pthread_mutex_lock(lock);
+        for (; i < n; i++)
+        {
+            cmd[0] = htole32((reg+i) | SBC_READ);
+            if ((status = toscaSbcWait(cmd)) != 0) break;
+            values[i] = le32toh(cmd[1]);
+        }
+        pthread_mutex_unlock(lock);
     }
+    if (status == 0) errno = 0; /* nanosleep may have been interrupted */
+    return status;
+}
+
+int toscaSbcWriteBlock(unsigned int fmc, unsigned int reg, unsigned int count,
+    unsigned int mask, const unsigned int values[], unsigned int readback[])
+{
+    volatile uint32_t* cmd;
+    pthread_mutex_t* lock;
+    unsigned int i = 0, n, value;
+    int status = 0;
+
     errno = 0;
-    if (csr == (void*)-1) csr = toscaMap((toscaDeviceType(0) == 0x1211 ? 0x10000 : 0)|TOSCA_CSR, 0, 0, 0);
-    if (!csr) return (unsigned int)-1;
-    debug("fmc=%i, reg=0x%x, mask=0x%x, value=0x%x", fmc, reg, mask, value);
-    addr = (CSR_SERIAL_BUS_CONTROLER + --fmc * 0x100)/4;
-    pthread_mutex_lock(&sbc_mutex[fmc]);
-    if (mask != 0xffffffff)
+    if (!(lock = toscaSbcCmd(fmc, &cmd))) return -1;
+    debug("fmc=0x%x, reg=0x%x, count=%u, mask=0x%x, readback=%s", fmc, reg, count, mask, readback ? "yes" : "no");
+    while (i < count && status == 0)
     {
-        csr[addr] = htole32(reg | 0x8000000); /* read cmd */
-        while ((le32toh(csr[addr]) & 0x80000000) && tries_left--); /* wait for read complete */
-        value &= mask;
-        value |= le32toh(csr[addr+1]) & ~mask;
+        n = i + SBC_CHUNK < count ? i + SBC_CHUNK : count;
+        pthread_mutex_lock(lock);
+        for (; i < n; i++)
+        {
+            value = values[i];
+            if (mask != 0xffffffff)
+            {
+                cmd[0] = htole32((reg+i) | SBC_READ);
+                if ((status = toscaSbcWait(cmd)) != 0) break;
+                value = (value & mask) | (le32toh(cmd[1]) & ~mask);
+            }
+            /* posted writes arrive in order, no flush needed before the command */
+            cmd[1] = htole32(value);
+            cmd[0] = htole32((reg+i) | SBC_WRITE);
+            if ((status = toscaSbcWait(cmd)) != 0) break;
+            if (readback)
+            {
+                cmd[0] = htole32((reg+i) | SBC_READ);
+                if ((status = toscaSbcWait(cmd)) != 0) break;
+                readback[i] = le32toh(cmd[1]);
+            }
+        }
+        pthread_mutex_unlock(lock);
     }
-    if (mask != 0)
+    if (status == 0) errno = 0; /* nanosleep may have been interrupted */
+    return status;
+}
+
+unsigned int toscaSbcWriteMasked(unsigned int fmc, unsigned int reg, unsigned int mask, unsigned int value)
+{
+    debug("fmc=0x%x, reg=0x%x, mask=0x%x, value=0x%x", fmc, reg, mask, value);
+    if (mask == 0)
     {
-        csr[addr+1] = htole32(value);
-        (void) csr[addr+1]; /* read back to flush */
-        csr[addr] = htole32(reg | 0xc000000); /* write cmd */
-        while ((le32toh(csr[addr]) & 0x80000000) && tries_left--); /* wait for write complete */
-        
-        /* read back value */
-        csr[addr] = htole32(reg | 0x8000000); /* read cmd */
-        while ((le32toh(csr[addr]) & 0x80000000) && tries_left--); /* wait for read complete */
-        value = le32toh(csr[addr+1]);
+        if (toscaSbcReadBlock(fmc, reg, 1, &value) != 0) return (unsigned int)-1;
     }
-    debug("fmc=%i, reg=0x%x, readback=0x%x", fmc, reg, value);
-    debugLvl(3, "tries_left: %i", tries_left);
-    pthread_mutex_unlock(&sbc_mutex[fmc]);
-    if (tries_left == 0)
+    else
     {
-        errno = EIO;
-        return (unsigned int)-1;
+        if (toscaSbcWriteBlock(fmc, reg, 1, mask, &value, &value) != 0) return (unsigned int)-1;
     }
+    debug("fmc=0x%x, reg=0x%x, readback=0x%x", fmc, reg, value);
     return value;
 }
 
@@ -47,6 +47,10 @@ unsigned int toscaWrite(unsigned int addrspace, unsigned int address, unsigned i
 unsigned int toscaSet(unsigned int addrspace, unsigned int address, unsigned int bitsToSet);
 unsigned int toscaClear(unsigned int addrspace, unsigned int address, unsigned int bitsToClear);
 
+/* Write without read back (does not wait for the write to complete). */
+/* Returns 0 on success or -1 and sets errno. */
+int toscaWritePosted(unsigned int addrspace, unsigned int address, unsigned int value);
+
 /* Access to Virtex-6 System Monitor via TCSR */
 /* Address range is 0x00 to 0x7c but only addresses from 0x40 on are writable. */
 unsigned int toscaSmonRead(unsigned int address);
@@ -55,6 +59,10 @@ unsigned int toscaSmonWriteMasked(unsigned int address, unsigned int mask, unsig
 unsigned int toscaSmonSet(unsigned int address, unsigned int bitsToSet);
 unsigned int toscaSmonClear(unsigned int address, unsigned int bitsToClear);
 
+/* Reads count Smon registers (without device bits) of one device in one go. */
+/* Returns 0 on success or -1 and sets errno. */
+int toscaSmonReadList(unsigned int device, unsigned int count, const unsigned int addresses[], unsigned int values[]);
+
 /* If you prefer to access Tosca CSR or IO directly using
    toscaMap instead of using functions above,
    be aware that all registers are little endian.
@@ -69,6 +77,20 @@ unsigned int toscaPonWriteMasked(unsigned int address, unsigned int mask, unsign
 unsigned int toscaPonSet(unsigned int address, unsigned int bitsToSet);
 unsigned int toscaPonClear(unsigned int address, unsigned int bitsToClear);
 
+/* Reads count PON registers in one pass. */
+/* Returns 0 on success or -1 and sets errno. */
+int toscaPonReadList(unsigned int count, const unsigned int addresses[], unsigned int values[]);
+
+/* PON registers are accessed through a UIO memory map if the platform provides it, else through sysfs. */
+/* Returns 1 if the memory map is used. Set toscaPonDirect to 0 to always use sysfs. */
+int toscaPonDirectAccess(void);
+extern int toscaPonDirect;
+
+/* Returns a pointer to the PON register in the memory map for repeated reads */
+/* (values need bswap_32() if *swap is set after the call). */
+/* Returns NULL with errno 0 if only sysfs access is available or with errno EINVAL for invalid addresses. */
+volatile uint32_t* toscaPonRegPtr(unsigned int address, int* swap);
+
 /* Read (and clear) VME error status. Error is latched and not overwritten until read. */
 typedef struct {
     uint64_t address;         /* Lowest two bits are always 0. */
@@ -89,12 +111,24 @@ typedef struct {
 toscaMapVmeErr_t toscaGetVmeErr(unsigned int device);
 
 /* Access to FMC 1 or 2 via TSCR Serial Bus Controller registers */
+/* fmc_slot 1 or 2 uses the default device (device 1 on IFC1211, else 0). */
+/* Use TOSCA_SBC_SLOT(device, fmc) for the slots of other Tosca devices. */
+/* Different slots can be accessed in parallel. */
+#define TOSCA_SBC_SLOT(device, fmc) ((((device)+1)<<16)|(fmc))
 unsigned int toscaSbcRead(unsigned int fmc_slot, unsigned int reg);
 unsigned int toscaSbcWrite(unsigned int fmc_slot, unsigned int reg, unsigned int value);
 unsigned int toscaSbcWriteMasked(unsigned int fmc_slot, unsigned int reg, unsigned int mask, unsigned int value);
 unsigned int toscaSbcSet(unsigned int fmc_slot, unsigned int reg, unsigned int bitsToSet);
 unsigned int toscaSbcClear(unsigned int fmc_slot, unsigned int reg, unsigned int bitsToClear);
 
+/* Access count consecutive registers starting at reg. */
+/* The lock is released every few registers to let other users in. */
+/* Masked writes read the registers first. With readback == NULL registers are not read back after writing. */
+/* Return 0 on success or -1 and set errno. */
+int toscaSbcReadBlock(unsigned int fmc_slot, unsigned int reg, unsigned int count, unsigned int values[]);
+int toscaSbcWriteBlock(unsigned int fmc_slot, unsigned int reg, unsigned int count,
+    unsigned int mask, const unsigned int values[], unsigned int readback[]);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,226 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "toscaMap.h"
+#include "toscaSlaveMem.h"
+
+#define TOSCA_DEBUG_NAME toscaSlaveMem
+#include "toscaDebug.h"
+
+/* Buddy allocator:
+   The administration data is kept outside of the windows because other
+   VME masters may (accidentally) write into free blocks.
+   Each window is divided into units of 1<<MIN_ORDER bytes.
+   For the first unit of each block, order[] holds its size class (| FREE).
+   Free blocks are in doubly linked lists of unit numbers, one per order.
+*/
+
+#define MIN_ORDER 8
+#define MAX_ORDER 22
+#define FREE      0x80
+#define NONE      0xff
+
+struct window {
+    struct window* next;
+    unsigned int device;
+    char* base;
+    uint64_t vmeaddress;
+    size_t size;
+    size_t used;
+    uint8_t* order;
+    int32_t* nextfree;
+    int32_t* prevfree;
+    int32_t freelist[MAX_ORDER+1];
+};
+
+static struct window* windows;
+static pthread_mutex_t slavemem_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void freelistAdd(struct window* w, int32_t unit, unsigned int order)
+{
+    w->order[unit] = order | FREE;
+    w->prevfree[unit] = -1;
+    w->nextfree[unit] = w->freelist[order];
+    if (w->freelist[order] >= 0)
+        w->prevfree[w->freelist[order]] = unit;
+    w->freelist[order] = unit;
+}
+
+static void freelistRemove(struct window* w, int32_t unit, unsigned int order)
+{
+    if (w->prevfree[unit] >= 0)
+        w->nextfree[w->prevfree[unit]] = w->nextfree[unit];
+    else
+        w->freelist[order] = w->nextfree[unit];
+    if (w->nextfree[unit] >= 0)
+        w->prevfree[w->nextfree[unit]] = w->prevfree[unit];
+    w->order[unit] = order;
+}
+
+int toscaSlaveMemAddWindow(unsigned int addrspace, uint64_t address, size_t size)
+{
+    struct window* w;
+    size_t units, offset;
+    unsigned int order;
+
+    debug("addrspace=%s address=0x%"PRIx64" size=0x%zx", toscaAddrSpaceToStr(addrspace), address, size);
+    if ((addrspace & 0xffff & ~VME_A32) || (address & 0xfffff) || size < (1 << MIN_ORDER) || size > (1 << MAX_ORDER))
+    {
+        error("need A32 address aligned to 1 MB and size up to 4 MB");
+        errno = EINVAL;
+        return -1;
+    }
+    size &= ~((1 << MIN_ORDER) - 1);
+    units = size >> MIN_ORDER;
+    w = calloc(1, sizeof(struct window) + units * (sizeof(uint8_t) + 2 * sizeof(int32_t)));
+    if (!w) return -1;
+    w->nextfree = (int32_t*)(w + 1);
+    w->prevfree = w->nextfree + units;
+    w->order = (uint8_t*)(w->prevfree + units);
+    memset(w->order, NONE, units);
+    for (order = 0; order <= MAX_ORDER; order++)
+        w->freelist[order] = -1;
+    w->base = (char*)toscaMap(VME_SLAVE|VME_A32|(addrspace & 0xffff0000), address, size, 0);
+    if (!w->base)
+    {
+        debugErrno("toscaMap SLAVE:0x%"PRIx64" 0x%zx", address, size);
+        free(w);
+        return -1;
+    }
+    w->device = addrspace >> 16;
+    w->vmeaddress = address;
+    w->size = size;
+
+    /* cut the window into the largest aligned blocks */
+    for (offset = 0; offset < size; offset += (size_t)1 << order)
+    {
+        for (order = MAX_ORDER; order > MIN_ORDER; order--)
+            if (!(offset & (((size_t)1 << order) - 1)) && offset + ((size_t)1 << order) <= size) break;
+        freelistAdd(w, offset >> MIN_ORDER, order);
+    }
+
+    pthread_mutex_lock(&slavemem_mutex);
+    w->next = windows;
+    windows = w;
+    pthread_mutex_unlock(&slavemem_mutex);
+    return 0;
+}
+
+void* toscaSlaveMemAlloc(unsigned int device, size_t size, size_t align, uint64_t* vmeaddress)
+{
+    struct window* w;
+    unsigned int order, o;
+    int32_t unit;
+    void* ptr = NULL;
+
+    if (align > size) size = align;
+    for (order = MIN_ORDER; order <= MAX_ORDER && ((size_t)1 << order) < size; order++);
+    if (order > MAX_ORDER || (align & (align - 1)) || align > 0x100000)
+    {
+        debug("size=0x%zx align=0x%zx not possible", size, align);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    pthread_mutex_lock(&slavemem_mutex);
+    for (w = windows; w; w = w->next)
+    {
+        if (w->device != device) continue;
+        for (o = order; o <= MAX_ORDER && w->freelist[o] < 0; o++);
+        if (o > MAX_ORDER) continue;
+        unit = w->freelist[o];
+        freelistRemove(w, unit, o);
+        /* split, keep the upper halves free */
+        while (o > order)
+        {
+            o--;
+            freelistAdd(w, unit + (1 << (o - MIN_ORDER)), o);
+        }
+        w->order[unit] = order;
+        w->used += (size_t)1 << order;
+        ptr = w->base + ((size_t)unit << MIN_ORDER);
+        if (vmeaddress) *vmeaddress = w->vmeaddress + ((size_t)unit << MIN_ORDER);
+        break;
+    }
+    pthread_mutex_unlock(&slavemem_mutex);
+    debug("device=%u size=0x%zx align=0x%zx: %p", device, size, align, ptr);
+    if (!ptr) errno = ENOMEM;
+    return ptr;
+}
+
+static struct window* toscaSlaveMemFind(const void* ptr)
+{
+    struct window* w;
+
+    for (w = windows; w; w = w->next)
+        if ((const char*)ptr >= w->base && (const char*)ptr < w->base + w->size) return w;
+    return NULL;
+}
+
+void toscaSlaveMemFree(void* ptr)
+{
+    struct window* w;
+    int32_t unit, buddy;
+    unsigned int order;
+
+    if (!ptr) return;
+    pthread_mutex_lock(&slavemem_mutex);
+    w = toscaSlaveMemFind(ptr);
+    if (!w || (((char*)ptr - w->base) & ((1 << MIN_ORDER) - 1)) ||
+        (w->order[unit = ((char*)ptr - w->base) >> MIN_ORDER] & FREE))
+    {
+        pthread_mutex_unlock(&slavemem_mutex);
+        error("%p is not an allocated block", ptr);
+        return;
+    }
+    order = w->order[unit];
+    w->used -= (size_t)1 << order;
+    /* merge with free buddies */
+    while (order < MAX_ORDER)
+    {
+        buddy = unit ^ (1 << (order - MIN_ORDER));
+        if (((size_t)buddy << MIN_ORDER) >= w->size || w->order[buddy] != (order | FREE)) break;
+        freelistRemove(w, buddy, order);
+        w->order[buddy] = NONE;
+        w->order[unit] = NONE;
+        if (buddy < unit) unit = buddy;
+        order++;
+    }
+    freelistAdd(w, unit, order);
+    pthread_mutex_unlock(&slavemem_mutex);
+    debug("%p", ptr);
+}
+
+uint64_t toscaSlaveMemVmeAddr(const void* ptr)
+{
+    struct window* w;
+    uint64_t address = (uint64_t)-1;
+
+    pthread_mutex_lock(&slavemem_mutex);
+    w = toscaSlaveMemFind(ptr);
+    if (w) address = w->vmeaddress + ((const char*)ptr - w->base);
+    pthread_mutex_unlock(&slavemem_mutex);
+    return address;
+}
+
+void toscaSlaveMemShow(int level)
+{
+    struct window* w;
+    unsigned int order;
+    int32_t unit;
+
+    pthread_mutex_lock(&slavemem_mutex);
+    for (w = windows; w; w = w->next)
+    {
+        printf("%u:SLAVE32:0x%"PRIx64" 0x%zx at %p, 0x%zx used\n",
+            w->device, w->vmeaddress, w->size, w->base, w->used);
+        if (level < 1) continue;
+        for (order = MIN_ORDER; order <= MAX_ORDER; order++)
+            for (unit = w->freelist[order]; unit >= 0; unit = w->nextfree[unit])
+                printf("   free 0x%"PRIx64" 0x%zx\n",
+                    w->vmeaddress + ((size_t)unit << MIN_ORDER), (size_t)1 << order);
+    }
+    pthread_mutex_unlock(&slavemem_mutex);
+}
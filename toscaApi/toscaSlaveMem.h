@@ -0,0 +1,46 @@
+#ifndef toscaSlaveMem_h
+#define toscaSlaveMem_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* set to 1 to see debug output */
+extern int toscaSlaveMemDebug;
+
+/* set to redirect debug output  */
+extern FILE* toscaSlaveMemDebugFile;
+
+/* Sub-allocator for RAM visible on VME through a few VME_SLAVE windows.
+   Blocks are taken from power of 2 size classes (256 bytes to 4 MB, buddy system)
+   and are aligned to their size class on VME (up to 1 MB, the window alignment).
+*/
+
+int toscaSlaveMemAddWindow(unsigned int addrspace, uint64_t address, size_t size);
+/* Maps size bytes (up to 4 MB) of RAM to VME at address with toscaMap(VME_SLAVE|addrspace, ...) */
+/* and adds it to the pool. Use addrspace 0 or VME_A32 ( | device<<16). */
+/* Returns 0 or -1 and sets errno. */
+
+void* toscaSlaveMemAlloc(unsigned int device, size_t size, size_t align, uint64_t* vmeaddress);
+/* Allocates size bytes aligned to align (power of 2) on VME from the windows of device. */
+/* Sets *vmeaddress (if not NULL) to the A32 address of the block on VME. */
+/* Returns NULL and sets errno to ENOMEM if no block is available. */
+
+void toscaSlaveMemFree(void* ptr);
+/* Returns a block to the pool. ptr NULL is ignored. */
+
+uint64_t toscaSlaveMemVmeAddr(const void* ptr);
+/* Returns the VME A32 address of ptr (inside any block) or (uint64_t)-1. */
+
+void toscaSlaveMemShow(int level);
+/* Prints windows and usage. With level > 0, also the free blocks. */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,260 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <endian.h>
+#ifndef le32toh
+#if  __BYTE_ORDER == __LITTLE_ENDIAN
+#define le32toh(x) (x)
+#else
+#include <byteswap.h>
+#define le32toh(x) __bswap_32(x)
+#endif
+#endif
+
+#include "toscaMap.h"
+#include "toscaDma.h"
+#include "toscaStream.h"
+
+#define TOSCA_DEBUG_NAME toscaStream
+#include "toscaDebug.h"
+
+/* Positions are running byte counts, only their difference matters.
+   The producer (toscaStreamUpdate) announces the range it is about to
+   overwrite in "reserved" before the DMA and publishes it in "head" after.
+   The consumer (window or latest) checks "reserved" after using the data
+   to find out if it has been overwritten meanwhile.
+*/
+
+struct toscaStream {
+    unsigned int dmaspace;
+    uint64_t base;
+    size_t size;
+    unsigned int swap;
+    volatile uint32_t* wrptr;
+    intrmask_t intrmask;
+    toscaStreamCallback callback;
+    void* user;
+    pthread_mutex_t lock;
+    size_t hwpos;
+    char* buffer;
+    size_t hostsize;
+    volatile unsigned long head, reserved, tail;
+    toscaStreamStats_t stats;
+};
+
+static void toscaStreamIntrHandler(toscaStream_t* stream, int inum __attribute__((unused)), int ivec __attribute__((unused)))
+{
+    toscaStreamUpdate(stream);
+}
+
+toscaStream_t* toscaStreamOpen(unsigned int dmaspace, uint64_t base, size_t size, unsigned int swap,
+    unsigned int wrptrspace, uint64_t wrptraddr, size_t hostsize, intrmask_t intrmask,
+    toscaStreamCallback callback, void* user)
+{
+    toscaStream_t* stream;
+    size_t s;
+
+    debug("dmaspace=%s base=0x%"PRIx64" size=0x%zx swap=%u wrptr=%s:0x%"PRIx64" hostsize=0x%zx intrmask=0x%"PRIx64,
+        toscaDmaSpaceToStr(dmaspace), base, size, swap, toscaAddrSpaceToStr(wrptrspace), wrptraddr,
+        hostsize, intrmask);
+
+    if (!size || (size & 7) || (base & 7))
+    {
+        error("invalid stream region 0x%"PRIx64"[0x%zx], must be multiple of 8", base, size);
+        errno = EINVAL;
+        return NULL;
+    }
+    if (hostsize < 2 * size) hostsize = 2 * size;
+    for (s = 8; s < hostsize; s <<= 1);
+    hostsize = s;
+
+    stream = calloc(1, sizeof(toscaStream_t));
+    if (!stream) return NULL;
+    stream->dmaspace = dmaspace;
+    stream->base = base;
+    stream->size = size;
+    stream->swap = swap;
+    stream->hostsize = hostsize;
+    stream->stats.hostsize = hostsize;
+    stream->callback = callback;
+    stream->user = user;
+    pthread_mutex_init(&stream->lock, NULL);
+
+    stream->wrptr = toscaMap(wrptrspace, wrptraddr, 4, 0);
+    if (!stream->wrptr)
+    {
+        error("cannot map write pointer %s:0x%"PRIx64": %m", toscaAddrSpaceToStr(wrptrspace), wrptraddr);
+        goto fail;
+    }
+    stream->buffer = toscaDmaAlloc(hostsize);
+    if (!stream->buffer)
+    {
+        error("cannot allocate host ring of 0x%zx bytes: %m", hostsize);
+        goto fail;
+    }
+    /* start with data arriving from now on */
+    stream->hwpos = (le32toh(*stream->wrptr) & ~7) % size;
+
+    if (intrmask)
+    {
+        if (toscaIntrConnectHandler(intrmask, toscaStreamIntrHandler, stream) != 0)
+        {
+            error("cannot connect interrupt 0x%"PRIx64": %m", intrmask);
+            goto fail;
+        }
+        stream->intrmask = intrmask;
+    }
+    return stream;
+
+fail:
+    toscaDmaFree(stream->buffer);
+    free(stream);
+    return NULL;
+}
+
+ssize_t toscaStreamUpdate(toscaStream_t* stream)
+{
+    uint32_t wrptr;
+    size_t new, done = 0;
+    int status = 0;
+
+    pthread_mutex_lock(&stream->lock);
+    wrptr = le32toh(*stream->wrptr) & ~7;
+    if (wrptr >= stream->size)
+    {
+        pthread_mutex_unlock(&stream->lock);
+        error("write pointer 0x%x out of range 0x%zx", wrptr, stream->size);
+        stream->stats.errors++;
+        errno = ERANGE;
+        return -1;
+    }
+    new = (wrptr + stream->size - stream->hwpos) % stream->size;
+    stream->reserved = stream->head + new;
+    __sync_synchronize();
+    while (done < new)
+    {
+        size_t chunk = new - done;
+        size_t hostpos = (stream->head + done) & (stream->hostsize - 1);
+
+        if (chunk > stream->size - stream->hwpos) chunk = stream->size - stream->hwpos;
+        if (chunk > stream->hostsize - hostpos) chunk = stream->hostsize - hostpos;
+        if (chunk > 0x1000000) chunk = 0x1000000; /* max DMA size */
+        debugLvl(2, "0x%"PRIx64"[0x%zx] -> host 0x%zx", stream->base + stream->hwpos, chunk, hostpos);
+        status = toscaDmaRead(stream->dmaspace, stream->base + stream->hwpos,
+            stream->buffer + hostpos, chunk, stream->swap, 0, NULL, NULL);
+        if (status != 0)
+        {
+            errno = status;
+            debugErrno("toscaDmaRead %s:0x%"PRIx64"[0x%zx]",
+                toscaDmaSpaceToStr(stream->dmaspace), stream->base + stream->hwpos, chunk);
+            stream->stats.errors++;
+            break;
+        }
+        stream->stats.transfers++;
+        done += chunk;
+        stream->hwpos = (stream->hwpos + chunk) % stream->size;
+    }
+    __sync_synchronize();
+    stream->head += done;
+    stream->reserved = stream->head;
+    stream->stats.received += done;
+    pthread_mutex_unlock(&stream->lock);
+
+    if (done && stream->callback)
+        stream->callback(stream->user, done);
+    if (status != 0)
+    {
+        errno = status;
+        return -1;
+    }
+    return done;
+}
+
+size_t toscaStreamWindow(toscaStream_t* stream, const volatile void** data)
+{
+    unsigned long head = stream->head;
+    size_t pos, len;
+
+    __sync_synchronize();
+    if (stream->reserved - stream->tail > stream->hostsize)
+    {
+        /* consumer too slow, continue with the newest data */
+        stream->stats.overruns++;
+        stream->stats.lost += head - stream->tail;
+        stream->tail = head;
+    }
+    pos = stream->tail & (stream->hostsize - 1);
+    len = head - stream->tail;
+    if (len > stream->hostsize - pos) len = stream->hostsize - pos;
+    *data = stream->buffer + pos;
+    return len;
+}
+
+int toscaStreamConsume(toscaStream_t* stream, size_t bytes)
+{
+    int overwritten;
+
+    __sync_synchronize();
+    overwritten = stream->reserved - stream->tail > stream->hostsize;
+    stream->tail += bytes;
+    if (overwritten)
+    {
+        stream->stats.overruns++;
+        errno = EOVERFLOW;
+        return -1;
+    }
+    return 0;
+}
+
+size_t toscaStreamLatest(toscaStream_t* stream, void* dest, size_t bytes)
+{
+    int retry;
+
+    if (bytes > stream->hostsize / 2) bytes = stream->hostsize / 2;
+    for (retry = 0; retry < 3; retry++)
+    {
+        unsigned long head = stream->head;
+        unsigned long start;
+        size_t pos, len = bytes, first;
+
+        __sync_synchronize();
+        if (len > head) len = head;
+        start = head - len;
+        pos = start & (stream->hostsize - 1);
+        first = stream->hostsize - pos;
+        if (first > len) first = len;
+        memcpy(dest, stream->buffer + pos, first);
+        memcpy((char*)dest + first, stream->buffer, len - first);
+        __sync_synchronize();
+        if (stream->reserved - start <= stream->hostsize)
+        {
+            stream->tail = head;
+            return len;
+        }
+        stream->stats.overruns++;
+    }
+    return 0;
+}
+
+toscaStreamStats_t toscaStreamGetStats(toscaStream_t* stream)
+{
+    toscaStreamStats_t stats = stream->stats;
+    stats.fill = stream->head - stream->tail;
+    return stats;
+}
+
+void toscaStreamClose(toscaStream_t* stream)
+{
+    if (!stream) return;
+    if (stream->intrmask)
+    {
+        toscaIntrDisconnectHandler(stream->intrmask, toscaStreamIntrHandler, stream);
+        /* Do not free stream, the interrupt thread may still use it (same as with handlers). */
+        return;
+    }
+    pthread_mutex_destroy(&stream->lock);
+    toscaDmaFree(stream->buffer);
+    free(stream);
+}
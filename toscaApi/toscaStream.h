@@ -0,0 +1,76 @@
+#ifndef toscaStream_h
+#define toscaStream_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "toscaIntr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* set to 1 to see debug output */
+extern int toscaStreamDebug;
+
+/* set to redirect debug output  */
+extern FILE* toscaStreamDebugFile;
+
+typedef struct toscaStream toscaStream_t;
+
+typedef void (*toscaStreamCallback)(void* user, size_t newbytes);
+
+toscaStream_t* toscaStreamOpen(unsigned int dmaspace, uint64_t base, size_t size, unsigned int swap,
+    unsigned int wrptrspace, uint64_t wrptraddr, size_t hostsize, intrmask_t intrmask,
+    toscaStreamCallback callback, void* user);
+/* Streams data which the FPGA writes continuously into the circular region [base, base+size)
+   of dmaspace (TOSCA_SMEM1, TOSCA_SMEM2, TOSCA_USER1, TOSCA_USER2) into a host ring buffer.
+   The FPGA publishes its write position as a byte offset into the region in a
+   32 bit little endian register at wrptraddr in wrptrspace (e.g. TOSCA_USER1).
+   New data is transferred with DMA (swap like toscaDmaSetup) in chunks split at the wrap around of both rings.
+   With intrmask != 0 new data is fetched in the interrupt handler thread whenever one of the interrupts arrives,
+   else call toscaStreamUpdate() periodically.
+   base and size must be multiples of 8, hostsize is rounded up to a power of 2 (at least 2*size).
+   The write pointer is rounded down to a multiple of 8.
+   The callback (if any) is called after each update with new data.
+   Returns NULL and sets errno on error.
+*/
+
+ssize_t toscaStreamUpdate(toscaStream_t*);
+/* Reads the write pointer and transfers new data to the host ring. */
+/* Returns number of new bytes or -1 and sets errno. */
+
+size_t toscaStreamWindow(toscaStream_t*, const volatile void** data);
+/* Zero copy access for one consumer: sets *data to the oldest unread data in the host ring */
+/* and returns the number of contiguous bytes available there (0 if none). */
+/* If the consumer was too slow, unread data is skipped and counted as overrun. */
+
+int toscaStreamConsume(toscaStream_t*, size_t bytes);
+/* Releases bytes from the window after use. */
+/* Returns 0 or -1 with errno EOVERFLOW if the data has been overwritten meanwhile. */
+
+size_t toscaStreamLatest(toscaStream_t*, void* dest, size_t bytes);
+/* Copies the newest (up to) bytes to dest and marks everything as read. */
+/* Returns the number of bytes copied. */
+
+typedef struct {
+    size_t hostsize;     /* size of host ring */
+    size_t fill;         /* unread bytes */
+    uint64_t received;   /* total bytes received */
+    uint64_t transfers;  /* number of DMA transfers */
+    uint64_t errors;     /* failed updates */
+    uint64_t overruns;   /* number of times unread data was overwritten */
+    uint64_t lost;       /* number of bytes skipped */
+} toscaStreamStats_t;
+
+toscaStreamStats_t toscaStreamGetStats(toscaStream_t*);
+
+void toscaStreamClose(toscaStream_t*);
+/* Disconnects from interrupts and releases the stream.
+   A stream with interrupts is not freed because its handler may still run. */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
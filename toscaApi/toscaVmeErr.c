@@ -0,0 +1,364 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "toscaMap.h"
+#include "toscaIntr.h"
+#include "toscaDma.h"
+#include "toscaVmeErr.h"
+
+#define TOSCA_DEBUG_NAME toscaVmeErr
+#include "toscaDebug.h"
+
+/* Producers (drain) and other latch readers are serialized by drain_mutex.
+   A slot is marked with stamp = seq+1 when complete and 0 while written,
+   thus readers can copy without lock and check if the slot changed meanwhile.
+*/
+
+static toscaVmeErrRecord_t ring[TOSCA_VME_ERR_RING];
+static volatile unsigned long stamp[TOSCA_VME_ERR_RING];
+static volatile unsigned long head;
+static pthread_mutex_t drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile uint32_t monitored;
+
+struct toscaVmeErrPoll {
+    unsigned int device;
+    unsigned int pollus;
+};
+
+int toscaVmeErrDrain(unsigned int device)
+{
+    toscaMapVmeErr_t err;
+    unsigned int slot;
+
+    pthread_mutex_lock(&drain_mutex);
+    errno = 0;
+    err = toscaGetVmeErr(device);
+    if (err.address == (uint64_t)-1 && errno)
+    {
+        pthread_mutex_unlock(&drain_mutex);
+        return -1;
+    }
+    if (!err.err)
+    {
+        pthread_mutex_unlock(&drain_mutex);
+        return 0;
+    }
+    slot = head % TOSCA_VME_ERR_RING;
+    stamp[slot] = 0;
+    __sync_synchronize();
+    clock_gettime(CLOCK_REALTIME, &ring[slot].time);
+    ring[slot].seq = head;
+    ring[slot].device = device;
+    ring[slot].err = err;
+    __sync_synchronize();
+    stamp[slot] = head + 1;
+    head++;
+    pthread_mutex_unlock(&drain_mutex);
+    debug("device %u: #%lu address=0x%"PRIx64" status=0x%x", device, ring[slot].seq, err.address, err.status);
+    return 1;
+}
+
+void toscaVmeErrLatchLock(void)
+{
+    pthread_mutex_lock(&drain_mutex);
+}
+
+void toscaVmeErrLatchUnlock(void)
+{
+    pthread_mutex_unlock(&drain_mutex);
+}
+
+unsigned long toscaVmeErrSeq(void)
+{
+    return head;
+}
+
+static void toscaVmeErrIntrHandler(void* device, int inum __attribute__((unused)), int ivec __attribute__((unused)))
+{
+    toscaVmeErrDrain((size_t)device);
+}
+
+static void* toscaVmeErrPollThread(void* arg)
+{
+    struct toscaVmeErrPoll poll = *(struct toscaVmeErrPoll*)arg;
+
+    free(arg);
+    while (1)
+    {
+        /* drain everything that has piled up */
+        while (toscaVmeErrDrain(poll.device) == 1);
+        usleep(poll.pollus);
+    }
+    return NULL;
+}
+
+int toscaVmeErrMonitorStart(unsigned int device, unsigned int pollus)
+{
+    debug("device=%u pollus=%u", device, pollus);
+    if (device >= 32 || device >= toscaNumDevices())
+    {
+        errno = ENODEV;
+        return -1;
+    }
+    if (monitored & (1 << device))
+    {
+        errno = EEXIST;
+        return -1;
+    }
+    /* start with an empty latch */
+    if (toscaVmeErrDrain(device) < 0)
+        return -1;
+    if (pollus == 0)
+    {
+        if (toscaIntrConnectHandler(TOSCA_VME_ERROR | (uint32_t)device<<24,
+            toscaVmeErrIntrHandler, (void*)(size_t)device) != 0)
+        {
+            error("cannot connect VME-ERROR interrupt of device %u: %m", device);
+            return -1;
+        }
+    }
+    else
+    {
+        pthread_t tid;
+        pthread_attr_t attr;
+        struct toscaVmeErrPoll* poll = malloc(sizeof(struct toscaVmeErrPoll));
+        int status;
+
+        if (!poll) return -1;
+        poll->device = device;
+        poll->pollus = pollus;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        status = pthread_create(&tid, &attr, toscaVmeErrPollThread, poll);
+        pthread_attr_destroy(&attr);
+        if (status != 0)
+        {
+            free(poll);
+            errno = status;
+            error("cannot start poll thread: %m");
+            return -1;
+        }
+    }
+    __sync_fetch_and_or(&monitored, 1 << device);
+    return 0;
+}
+
+int toscaVmeErrMonitorRunning(unsigned int device)
+{
+    return device < 32 && (monitored & (1 << device)) != 0;
+}
+
+/* Like toscaGetVmeErr shell command: the lowest address bits are not valid. */
+static uint64_t toscaVmeErrDecode(const toscaMapVmeErr_t* err, unsigned int* addrspace)
+{
+    switch (err->mode)
+    {
+        case 0:  *addrspace = VME_CRCSR; return err->address & 0xfffffc;
+        case 1:  *addrspace = VME_A16; return err->address & 0xfffc;
+        case 2:  *addrspace = VME_A24; return err->address & 0xfffffc;
+        case 15: *addrspace = 0; return err->address & 0xfffffffc; /* IACK */
+        default: *addrspace = VME_A32; return err->address & 0xfffffffc;
+    }
+}
+
+static int toscaVmeErrMatch(const toscaVmeErrFilter_t* filter, const toscaVmeErrRecord_t* r)
+{
+    unsigned int addrspace;
+    uint64_t address;
+
+    if (r->seq < filter->seq) return 0;
+    if (filter->device >= 0 && r->device != (unsigned int)filter->device) return 0;
+    address = toscaVmeErrDecode(&r->err, &addrspace);
+    if (filter->addrspace && filter->addrspace != addrspace) return 0;
+    if (filter->end && (address < filter->start || address >= filter->end)) return 0;
+    if (r->time.tv_sec < filter->since.tv_sec ||
+        (r->time.tv_sec == filter->since.tv_sec && r->time.tv_nsec < filter->since.tv_nsec)) return 0;
+    return 1;
+}
+
+size_t toscaVmeErrQuery(const toscaVmeErrFilter_t* filter, toscaVmeErrRecord_t records[], size_t maxrecords)
+{
+    static const toscaVmeErrFilter_t all = { .device = -1 };
+    unsigned long seq, end = head;
+    size_t n = 0;
+
+    if (!filter) filter = &all;
+    seq = end > TOSCA_VME_ERR_RING ? end - TOSCA_VME_ERR_RING : 0;
+    if (seq < filter->seq) seq = filter->seq;
+    for (; seq < end && n < maxrecords; seq++)
+    {
+        unsigned int slot = seq % TOSCA_VME_ERR_RING;
+
+        if (stamp[slot] != seq + 1) continue; /* overwritten or being written */
+        __sync_synchronize();
+        records[n] = ring[slot];
+        __sync_synchronize();
+        if (stamp[slot] != seq + 1) continue;
+        if (toscaVmeErrMatch(filter, &records[n])) n++;
+    }
+    return n;
+}
+
+/* Bus scan:
+   The error registers latch only the first error. Thus we access a chunk
+   of addresses and check the latch once. If one of our reads failed,
+   everything before it is present, it is absent, and we continue after it.
+   Foreign errors may hide ours, in that case repeat the chunk.
+*/
+
+#define SCAN_CHUNK 64
+
+/* Returns 1 and the address of our first failed read, 0 if none failed, -1 if unsure. */
+static int toscaVmeScanCheck(unsigned int device, unsigned int space, uint64_t lo, uint64_t hi,
+    unsigned long* seq, uint64_t* erraddr)
+{
+    toscaVmeErrRecord_t records[8];
+    size_t i, n;
+    int status = 0, foreign = 0;
+
+    if (toscaVmeErrMonitorRunning(device))
+    {
+        toscaVmeErrFilter_t filter = { .device = device, .seq = *seq };
+        toscaVmeErrDrain(device);
+        n = toscaVmeErrQuery(&filter, records, 8);
+        *seq = toscaVmeErrSeq();
+    }
+    else
+    {
+        errno = 0;
+        records[0].err = toscaGetVmeErr(device);
+        if (records[0].err.address == (uint64_t)-1 && errno) return -1;
+        n = records[0].err.err;
+    }
+    for (i = 0; i < n; i++)
+    {
+        unsigned int addrspace;
+        uint64_t address = toscaVmeErrDecode(&records[i].err, &addrspace);
+
+        if (records[i].err.source == 0 && !records[i].err.write &&
+            addrspace == space && address + 4 > lo && address < hi)
+        {
+            if (status == 0 || address < *erraddr) *erraddr = address;
+            status = 1;
+        }
+        else
+        {
+            debug("foreign error %s 0x%"PRIx64" source=%u", toscaAddrSpaceToStr(addrspace), address, records[i].err.source);
+            foreign = 1;
+        }
+    }
+    /* Without monitor, a foreign error in the latch means ours may be lost. */
+    if (foreign && (status == 0 || !toscaVmeErrMonitorRunning(device))) return -1;
+    return status;
+}
+
+static void toscaVmeScanRead(volatile void* ptr, unsigned int width)
+{
+    switch (width)
+    {
+        case 1: (void) *(volatile uint8_t*)ptr; break;
+        case 2: (void) *(volatile uint16_t*)ptr; break;
+        case 4: (void) *(volatile uint32_t*)ptr; break;
+    }
+}
+
+ssize_t toscaVmeScan(unsigned int addrspace, uint64_t start, uint64_t end, size_t stride, unsigned int width,
+    uint8_t* bitmap)
+{
+    unsigned int device = addrspace >> 16;
+    unsigned int space = addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32);
+    int dma = (width & TOSCA_VME_SCAN_DMA) != 0;
+    int monitor = toscaVmeErrMonitorRunning(device);
+    size_t count, i = 0, j, n, found = 0;
+    volatile char* base;
+    unsigned long seq;
+    uint64_t erraddr = 0;
+    uint32_t* buffer = NULL;
+    int retries = 0;
+
+    width &= ~TOSCA_VME_SCAN_DMA;
+    debug("%s:0x%"PRIx64"-0x%"PRIx64" stride=0x%zx width=%u%s",
+        toscaAddrSpaceToStr(addrspace), start, end, stride, width, dma ? " DMA" : "");
+    /* The error registers report addresses of 4 byte words only. */
+    if ((width != 1 && width != 2 && width != 4) || stride < 4 || (start & (width-1)) || (stride & (width-1)) ||
+        end <= start || (space & (space-1)) || !space)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    count = (end - start + stride - 1) / stride;
+    memset(bitmap, 0, (count + 7) / 8);
+    base = toscaMap(addrspace, start, end - start, 0);
+    if (!base)
+    {
+        debugErrno("toscaMap %s:0x%"PRIx64"[0x%"PRIx64"]", toscaAddrSpaceToStr(addrspace), start, end - start);
+        return -1;
+    }
+    /* DMA only in dense A32 ranges */
+    if (dma && (space != VME_A32 || width != 4 || stride != 4 || (start & 7)))
+        dma = 0;
+    if (dma && !(buffer = toscaDmaAlloc(SCAN_CHUNK * 4)))
+        return -1;
+
+    /* re-arm latch, without monitor per chunk */
+    if (monitor) toscaVmeErrDrain(device);
+    seq = toscaVmeErrSeq();
+
+    while (i < count)
+    {
+        uint64_t lo = start + i * stride;
+        int status;
+
+        n = count - i < SCAN_CHUNK ? count - i : SCAN_CHUNK;
+        if (!monitor)
+        {
+            toscaVmeErrLatchLock();
+            toscaGetVmeErr(device);
+        }
+        if (dma && n % 2 == 0)
+        {
+            /* A DMA error tells us only that something in the chunk is missing. */
+            status = toscaDmaRead((device << 16) | VME_SCT, lo, buffer, n * 4, 0, 0, NULL, NULL);
+            if (toscaVmeScanCheck(device, space, lo, lo + n * stride, &seq, &erraddr) == 0 && status == 0)
+            {
+                if (!monitor) toscaVmeErrLatchUnlock();
+                for (j = 0; j < n; j++) bitmap[(i+j) >> 3] |= 1 << ((i+j) & 7);
+                found += n;
+                i += n;
+                continue;
+            }
+        }
+        for (j = 0; j < n; j++)
+            toscaVmeScanRead(base + (i+j) * stride, width);
+        status = toscaVmeScanCheck(device, space, lo, lo + n * stride, &seq, &erraddr);
+        if (!monitor) toscaVmeErrLatchUnlock();
+        if (status < 0)
+        {
+            if (++retries > 10)
+            {
+                error("too many foreign VME errors");
+                toscaDmaFree(buffer);
+                errno = EIO;
+                return -1;
+            }
+            continue;
+        }
+        retries = 0;
+        if (status == 0)
+            j = n;
+        else
+        {
+            j = erraddr > lo ? (erraddr - lo) / stride : 0;
+            if (j >= n) j = n - 1;
+        }
+        debugLvl(2, "0x%"PRIx64": %zu present%s", lo, j, status ? ", then error" : "");
+        found += j;
+        while (j--) { bitmap[i >> 3] |= 1 << (i & 7); i++; }
+        if (status) i++;
+    }
+    toscaDmaFree(buffer);
+    return found;
+}
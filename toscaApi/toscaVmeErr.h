@@ -0,0 +1,92 @@
+#ifndef toscaVmeErr_h
+#define toscaVmeErr_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include "toscaReg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* set to 1 to see debug output */
+extern int toscaVmeErrDebug;
+
+/* set to redirect debug output  */
+extern FILE* toscaVmeErrDebugFile;
+
+/* The VME error register pair latches only one error until it is read.
+   A monitor drains it into a ring of the last TOSCA_VME_ERR_RING errors
+   which consumers can query without racing on the latch.
+*/
+
+#define TOSCA_VME_ERR_RING 256
+
+typedef struct {
+    struct timespec time;     /* CLOCK_REALTIME when the error was drained */
+    unsigned long seq;        /* running number of the error */
+    unsigned int device;
+    toscaMapVmeErr_t err;
+} toscaVmeErrRecord_t;
+
+int toscaVmeErrMonitorStart(unsigned int device, unsigned int pollus);
+/* Starts draining the error latch of device. */
+/* With pollus == 0 the latch is drained on TOSCA_VME_ERROR interrupts (needs toscaIntrLoop), */
+/* else a thread polls it every pollus microseconds. */
+/* Returns 0 on success or -1 and sets errno. */
+
+int toscaVmeErrMonitorRunning(unsigned int device);
+/* Returns 1 if a monitor is running for device, else 0. */
+
+int toscaVmeErrDrain(unsigned int device);
+/* Reads the latch now and adds the error (if any) to the ring. */
+/* Use this instead of toscaGetVmeErr() if monitors are running. */
+/* Returns 1 if an error was found, 0 if not, -1 on failure. */
+
+void toscaVmeErrLatchLock(void);
+void toscaVmeErrLatchUnlock(void);
+/* Without monitor, hold this lock while clearing the latch, accessing and reading */
+/* the latch again, so that probes and scans do not steal each other's errors. */
+/* Do not call toscaVmeErrDrain() while holding it. */
+
+unsigned long toscaVmeErrSeq(void);
+/* Returns the seq number the next error will get. */
+/* Remember it before an access to find the errors caused by it. */
+
+typedef struct {
+    int device;               /* -1: any */
+    unsigned int addrspace;   /* 0: any, else one of VME_CRCSR, VME_A16, VME_A24, VME_A32 */
+    uint64_t start, end;      /* address range [start, end), end == 0: any */
+    struct timespec since;    /* {0,0}: any */
+    unsigned long seq;        /* only errors with seq >= this */
+} toscaVmeErrFilter_t;
+
+size_t toscaVmeErrQuery(const toscaVmeErrFilter_t* filter, toscaVmeErrRecord_t records[], size_t maxrecords);
+/* Copies (up to maxrecords) matching errors still in the ring, oldest first. filter NULL matches all. */
+/* Block transfer modes count as VME_A32. Returns the number of records copied. */
+
+#define TOSCA_VME_SCAN_DMA 0x100
+
+ssize_t toscaVmeScan(unsigned int addrspace, uint64_t start, uint64_t end, size_t stride, unsigned int width,
+    uint8_t* bitmap);
+/* Reads width (1, 2, 4) bytes every stride bytes in [start, end) of addrspace */
+/* (VME_CRCSR, VME_A16, VME_A24, VME_A32, | device<<16) through one map and */
+/* sets bit i in bitmap if the read of start + i*stride did not fail with a VME bus error. */
+/* stride must be at least 4 because the error registers report addresses of 4 byte words only. */
+/* Bus errors are attributed by address, the error registers are only read once per */
+/* 64 addresses and once per missing address. Uses the error monitor if running. */
+/* After each missing address the next chunk starts right behind it and reads the */
+/* following addresses again, thus 64 addresses cost up to 64*64 reads if all are missing. */
+/* Without monitor, the latch is locked (see toscaVmeErrLatchLock) for each chunk. */
+/* With width | TOSCA_VME_SCAN_DMA, dense (stride == width == 4) A32 ranges are read with DMA first */
+/* and only chunks with errors are scanned again. */
+/* bitmap must hold (end-start+stride-1)/stride bits. */
+/* Returns the number of present addresses or -1 and sets errno. */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,12 +1,13 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include <devLibVME.h>
-#include <epicsMutex.h>
 #include <epicsTypes.h>
 
 #include "toscaMap.h"
 #include "toscaIntr.h"
 #include "toscaReg.h"
+#include "toscaVmeErr.h"
 
 #include <epicsExport.h>
 
@@ -111,7 +112,73 @@ long toscaDevLibMapAddr(
 
 /** VME probing *****************/
 
-epicsMutexId probeMutex;
+static int toscaDevLibAccess(
+    int isWrite,
+    unsigned int wordSize,
+    volatile const void *ptr,
+    void *pValue,
+    void *readptr)
+{
+    switch (wordSize)
+    {
+        case 1:
+            if (isWrite)
+                *(epicsUInt8 *)(ptr) = *(epicsUInt8 *)pValue;
+            else
+            *(epicsUInt8 *)readptr = *(epicsUInt8 *)(ptr);
+            return 0;
+        case 2:
+            if (isWrite)
+                *(epicsUInt16 *)(ptr) = *(epicsUInt16 *)pValue;
+            else
+            *(epicsUInt16 *)readptr = *(epicsUInt16 *)(ptr);
+            return 0;
+        case 4:
+            if (isWrite)
+                *(epicsUInt32 *)(ptr) = *(epicsUInt32 *)pValue;
+            else
+            *(epicsUInt32 *)readptr = *(epicsUInt32 *)(ptr);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/* With a running VME error monitor, errors of other accesses end up in
+   the error ring instead of being lost and we can look for our own.
+*/
+static long toscaDevLibProbeMonitored(
+    int isWrite,
+    unsigned int wordSize,
+    volatile const void *ptr,
+    void *pValue,
+    void *readptr,
+    toscaMapAddr_t vme_addr)
+{
+    toscaVmeErrFilter_t filter;
+    toscaVmeErrRecord_t records[8];
+    size_t i, n;
+
+    memset(&filter, 0, sizeof(filter));
+    filter.device = vme_addr.addrspace>>16;
+    filter.addrspace = vme_addr.addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32);
+    filter.start = vme_addr.address & ~3;
+    filter.end = filter.start + 4;
+    filter.seq = toscaVmeErrSeq();
+    if (toscaDevLibAccess(isWrite, wordSize, ptr, pValue, readptr) != 0)
+        return S_dev_badArgument;
+    toscaVmeErrDrain(filter.device);
+    n = toscaVmeErrQuery(&filter, records, 8);
+    for (i = 0; i < n; i++)
+    {
+        debug("VME bus error #%lu at %s 0x%"PRIx64, records[i].seq,
+            toscaAddrSpaceToStr(filter.addrspace), records[i].err.address);
+        if (records[i].err.source == 0 && /* Error from PCIe, maybe our access. */
+            isWrite == records[i].err.write) /* Read/write access matches. */
+            return S_dev_noDevice;
+    }
+    return S_dev_success;
+}
 
 long toscaDevLibProbe(
     int isWrite,
@@ -137,36 +204,20 @@ long toscaDevLibProbe(
 
     device = vme_addr.addrspace>>16;
 
-    epicsMutexMustLock(probeMutex);
+    if (toscaVmeErrMonitorRunning(device))
+        return toscaDevLibProbeMonitored(isWrite, wordSize, ptr, pValue, readptr, vme_addr);
+
+    toscaVmeErrLatchLock();
 
     /* Read once to clear BERR bit. */
     toscaGetVmeErr(device);
 
     for (i = 1; i < 1000; i++)  /* We don't want to loop forever. */
     {
-        switch (wordSize)
+        if (toscaDevLibAccess(isWrite, wordSize, ptr, pValue, readptr) != 0)
         {
-            case 1:
-                if (isWrite)
-                    *(epicsUInt8 *)(ptr) = *(epicsUInt8 *)pValue;
-                else
-                *(epicsUInt8 *)readptr = *(epicsUInt8 *)(ptr);
-                break;
-            case 2:
-                if (isWrite)
-                    *(epicsUInt16 *)(ptr) = *(epicsUInt16 *)pValue;
-                else
-                *(epicsUInt16 *)readptr = *(epicsUInt16 *)(ptr);
-                break;
-            case 4:
-                if (isWrite)
-                    *(epicsUInt32 *)(ptr) = *(epicsUInt32 *)pValue;
-                else
-                *(epicsUInt32 *)readptr = *(epicsUInt32 *)(ptr);
-                break;
-            default:
-                epicsMutexUnlock(probeMutex);
-                return S_dev_badArgument;
+            toscaVmeErrLatchUnlock();
+            return S_dev_badArgument;
         }
         vme_err = toscaGetVmeErr(device);
         if (!vme_err.err) break; /* No error: success */
@@ -184,7 +235,7 @@ long toscaDevLibProbe(
                     if ((vme_addr.addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_CRCSR &&
                         ((vme_err.address ^ vme_addr.address) & 0xfffffc) == 0)
                     {
-                        epicsMutexUnlock(probeMutex);
+                        toscaVmeErrLatchUnlock();
                         return S_dev_noDevice;
                     }
                     break;
@@ -193,7 +244,7 @@ long toscaDevLibProbe(
                     if ((vme_addr.addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_A16 &&
                         ((vme_err.address ^ vme_addr.address) & 0xfffc) == 0)
                     {
-                        epicsMutexUnlock(probeMutex);
+                        toscaVmeErrLatchUnlock();
                         return S_dev_noDevice;
                     }
                     break;
@@ -202,7 +253,7 @@ long toscaDevLibProbe(
                     if ((vme_addr.addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_A24 &&
                         ((vme_err.address ^ vme_addr.address) & 0xfffffc) == 0)
                     {
-                        epicsMutexUnlock(probeMutex);
+                        toscaVmeErrLatchUnlock();
                         return S_dev_noDevice;
                     }
                     break;
@@ -211,7 +262,7 @@ long toscaDevLibProbe(
                     if ((vme_addr.addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_A32 &&
                         ((vme_err.address ^ vme_addr.address) & 0xfffffffc) == 0)
                     {
-                        epicsMutexUnlock(probeMutex);
+                        toscaVmeErrLatchUnlock();
                         return S_dev_noDevice;
                     }
                     break;
@@ -219,7 +270,7 @@ long toscaDevLibProbe(
         debug("try again i=%d", i);
     } /* Repeat until success or error matches our address */
     /* ...or give up. All errors have always been on other addresses so far. */
-    epicsMutexUnlock(probeMutex);
+    toscaVmeErrLatchUnlock();
     return S_dev_success;
 }
 
@@ -247,14 +298,14 @@ long toscaDevLibWriteProbe(
 long toscaDevLibDisableInterruptLevelVME(unsigned int level)
 {
     if (level < 1 || level > 7) return S_dev_intEnFail;
-    toscaIntrDisable(TOSCA_VME_INTR(level));
+    toscaIntrGateVmeLevel(level, 1);
     return S_dev_success;
 }
 
 long toscaDevLibEnableInterruptLevelVME(unsigned int level)
 {
     if (level < 1 || level > 7) return S_dev_intDissFail;
-    toscaIntrEnable(TOSCA_VME_INTR(level));
+    toscaIntrGateVmeLevel(level, 0);
     return S_dev_success;
 }
 
@@ -292,6 +343,7 @@ void *toscaDevLibA24Malloc(size_t size __attribute__((unused)))
     /* This function should allocate some DMA capable memory
      * and map it into a A24 slave window.
      * But TOSCA supports only A32 slave windows.
+     * For A32 use toscaSlaveMemAlloc() instead.
      */
     return NULL;
 }
@@ -328,7 +380,6 @@ devLibVirtualOS toscaVirtualOS = {
 
 static void toscaDevLibRegistrar ()
 {
-    probeMutex = epicsMutexMustCreate();
     pdevLibVirtualOS = &toscaVirtualOS;
 }
 
@@ -17,6 +17,12 @@ epicsExportAddress(int, toscaIntrPrio);
 int toscaDmaPrio = 80;
 epicsExportAddress(int, toscaDmaPrio);
 
+int toscaIntrWorkerPrio = 70;
+epicsExportAddress(int, toscaIntrWorkerPrio);
+
+int toscaIntrWorkers = 2;
+epicsExportAddress(int, toscaIntrWorkers);
+
 int toscaIntrLoopStart(void)
 {
     epicsThreadId tid;
@@ -33,6 +39,29 @@ int toscaIntrLoopStart(void)
     return 0;
 }
 
+int toscaIntrWorkersStart(unsigned int n)
+{
+    epicsThreadId tid;
+    unsigned int i;
+    int status = 0;
+
+    debug("starting interrupt worker threads");
+    for (i = 1; i <= n; i++)
+    {
+        char name[32];
+        sprintf(name, "irqw%d-TOSCA", i);
+        tid = epicsThreadCreate(name, toscaIntrWorkerPrio,
+            epicsThreadGetStackSize(epicsThreadStackMedium),
+            (EPICSTHREADFUNC)toscaIntrWorkerLoop, NULL);
+        if (!tid) {
+            debugErrno("starting %s thread", name);
+            status = -1;
+        }
+        else debug("%s tid = %p", name, tid);
+    }
+    return status;
+}
+
 int toscaDmaLoopsStart(unsigned int n)
 {
     epicsThreadId tid;
@@ -82,6 +111,16 @@ void toscaInitHook(initHookState state)
     toscaIntrLoopStart();
     epicsAtExit(toscaIntrLoopStop,NULL);
 
+    if (toscaIntrWorkers < 0)
+    {
+        error("invalid toscaIntrWorkers=%d", toscaIntrWorkers);
+    }
+    else if (toscaIntrWorkers > 0)
+    {
+        toscaIntrWorkersStart(toscaIntrWorkers);
+        epicsAtExit(toscaIntrWorkersStop,NULL);
+    }
+
     toscaDmaLoopsStart(toscaDeviceType(0) == 0x1210 ? 2 : 4);
     epicsAtExit(toscaDmaLoopsStop,NULL);
 }
@@ -12,6 +12,7 @@ extern "C" {
    purposes.
 */ 
 int toscaIntrLoopStart(void);
+int toscaIntrWorkersStart(unsigned int number_of_threads);
 int toscaDmaLoopsStart(unsigned int number_of_threads);
 
 #ifdef __cplusplus
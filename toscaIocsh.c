@@ -16,6 +16,8 @@
 #include "toscaReg.h"
 #include "toscaIntr.h"
 #include "toscaDma.h"
+#include "toscaVmeErr.h"
+#include "toscaSlaveMem.h"
 #include "toscaInit.h"
 
 #include <epicsStdioRedirect.h>
@@ -215,15 +217,8 @@ static const iocshFuncDef toscaGetVmeErrDef =
     &(iocshArg) { "device", iocshArgInt },
 }};
 
-static void toscaGetVmeErrFunc(const iocshArgBuf *args)
+static void toscaPrintVmeErr(toscaMapVmeErr_t err)
 {
-    errno = 0;
-    toscaMapVmeErr_t err = toscaGetVmeErr(args[0].ival);
-    if (errno)
-    {
-        fprintf(stderr, "%m\n");
-        return;
-    }
     printf("0x%08"PRIx64",0x%"PRIx32" (%s %s%c%s %s id=%d len=%d %s:0x%"PRIx64")\n",
         err.address,
         err.status,
@@ -239,6 +234,185 @@ static void toscaGetVmeErrFunc(const iocshArgBuf *args)
         );
 }
 
+static void toscaGetVmeErrFunc(const iocshArgBuf *args)
+{
+    errno = 0;
+    toscaMapVmeErr_t err = toscaGetVmeErr(args[0].ival);
+    if (errno)
+    {
+        fprintf(stderr, "%m\n");
+        return;
+    }
+    toscaPrintVmeErr(err);
+}
+
+static const iocshFuncDef toscaVmeErrMonitorDef =
+    { "toscaVmeErrMonitor", 2, (const iocshArg *[]) {
+    &(iocshArg) { "device", iocshArgInt },
+    &(iocshArg) { "pollus (0: use VME-ERROR interrupt)", iocshArgInt },
+}};
+
+static void toscaVmeErrMonitorFunc(const iocshArgBuf *args)
+{
+    if (toscaVmeErrMonitorStart(args[0].ival, args[1].ival) != 0)
+        fprintf(stderr, "toscaVmeErrMonitor failed: %m\n");
+}
+
+static const iocshFuncDef toscaVmeErrShowDef =
+    { "toscaVmeErrShow", 3, (const iocshArg *[]) {
+    &(iocshArg) { "[device][:addrspace]", iocshArgString },
+    &(iocshArg) { "start address", iocshArgString },
+    &(iocshArg) { "end address", iocshArgString },
+}};
+
+static void toscaVmeErrShowFunc(const iocshArgBuf *args)
+{
+    toscaVmeErrFilter_t filter = { .device = -1 };
+    toscaVmeErrRecord_t records[TOSCA_VME_ERR_RING];
+    size_t i, n;
+
+    if (args[0].sval)
+    {
+        char* p;
+        filter.device = strtol(args[0].sval, &p, 0);
+        if (p == args[0].sval) filter.device = -1;
+        if (*p == ':') p++;
+        if (*p)
+        {
+            filter.addrspace = toscaStrToAddrSpace(p, NULL) & (VME_CRCSR|VME_A16|VME_A24|VME_A32);
+            if (!filter.addrspace)
+            {
+                fprintf(stderr, "invalid address space %s\n", p);
+                return;
+            }
+        }
+    }
+    if (args[1].sval)
+    {
+        filter.start = toscaStrToSize(args[1].sval);
+        filter.end = args[2].sval ? toscaStrToSize(args[2].sval) : filter.start + 4;
+    }
+    n = toscaVmeErrQuery(&filter, records, TOSCA_VME_ERR_RING);
+    for (i = 0; i < n; i++)
+    {
+        char timestr[40];
+        struct tm tm;
+
+        strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", localtime_r(&records[i].time.tv_sec, &tm));
+        printf("#%lu %s.%06ld %u: ", records[i].seq, timestr, records[i].time.tv_nsec / 1000, records[i].device);
+        toscaPrintVmeErr(records[i].err);
+    }
+}
+
+static const iocshFuncDef toscaVmeScanDef =
+    { "toscaVmeScan", 4, (const iocshArg *[]) {
+    &(iocshArg) { "[device:]addrspace:start", iocshArgString },
+    &(iocshArg) { "end", iocshArgString },
+    &(iocshArg) { "stride", iocshArgString },
+    &(iocshArg) { "width[dma]", iocshArgString },
+}};
+
+static void toscaVmeScanFunc(const iocshArgBuf *args)
+{
+    toscaMapAddr_t addr;
+    uint64_t end;
+    size_t stride, count, i, first;
+    unsigned int width = 4;
+    uint8_t* bitmap;
+    ssize_t found;
+    char* p;
+
+    if (!args[0].sval || !args[1].sval)
+    {
+        iocshCmd("help toscaVmeScan");
+        printf("addrspace: CRCSR, A16, A24, A32\n"
+               "stride: at least 4 (default), width: 1, 2, 4 (default), append 'dma' to try DMA in dense A32 ranges\n");
+        return;
+    }
+    addr = toscaStrToAddr(args[0].sval, NULL);
+    if (!(addr.addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)))
+    {
+        fprintf(stderr, "invalid VME address %s\n", args[0].sval);
+        return;
+    }
+    end = toscaStrToSize(args[1].sval);
+    if (args[3].sval)
+    {
+        width = strtoul(args[3].sval, &p, 0);
+        if (strcasecmp(p, "dma") == 0) width |= TOSCA_VME_SCAN_DMA;
+    }
+    stride = args[2].sval ? toscaStrToSize(args[2].sval) : 4;
+    if (end <= addr.address || !stride)
+    {
+        fprintf(stderr, "invalid range\n");
+        return;
+    }
+    count = (end - addr.address + stride - 1) / stride;
+    bitmap = malloc((count + 7) / 8);
+    if (!bitmap)
+    {
+        fprintf(stderr, "out of memory\n");
+        return;
+    }
+    found = toscaVmeScan(addr.addrspace, addr.address, end, stride, width, bitmap);
+    if (found < 0)
+        fprintf(stderr, "toscaVmeScan failed: %m\n");
+    else
+    {
+        /* print contiguous ranges */
+        for (i = 0; i < count; i++)
+        {
+            if (!(bitmap[i >> 3] & 1 << (i & 7))) continue;
+            first = i;
+            while (i + 1 < count && (bitmap[(i+1) >> 3] & 1 << ((i+1) & 7))) i++;
+            if (i == first)
+                printf("%s:0x%"PRIx64"\n", toscaAddrSpaceToStr(addr.addrspace), addr.address + first * stride);
+            else
+                printf("%s:0x%"PRIx64"-0x%"PRIx64"\n", toscaAddrSpaceToStr(addr.addrspace),
+                    addr.address + first * stride, addr.address + i * stride);
+        }
+        printf("%zd of %zu addresses present\n", found, count);
+    }
+    free(bitmap);
+}
+
+static const iocshFuncDef toscaSlaveMemWindowDef =
+    { "toscaSlaveMemWindow", 2, (const iocshArg *[]) {
+    &(iocshArg) { "[device:]SLAVE:address", iocshArgString },
+    &(iocshArg) { "size", iocshArgString },
+}};
+
+static void toscaSlaveMemWindowFunc(const iocshArgBuf *args)
+{
+    toscaMapAddr_t addr;
+
+    if (!args[0].sval || !args[1].sval)
+    {
+        iocshCmd("help toscaSlaveMemWindow");
+        printf("Adds RAM mapped to VME A32 to the pool for toscaSlaveMemAlloc\n"
+               "address must be 1M aligned, size up to 4M\n");
+        return;
+    }
+    addr = toscaStrToAddr(args[0].sval, NULL);
+    if (!(addr.addrspace & VME_SLAVE))
+    {
+        fprintf(stderr, "need SLAVE address\n");
+        return;
+    }
+    if (toscaSlaveMemAddWindow(addr.addrspace & ~VME_SLAVE, addr.address, toscaStrToSize(args[1].sval)) != 0)
+        fprintf(stderr, "toscaSlaveMemWindow failed: %m\n");
+}
+
+static const iocshFuncDef toscaSlaveMemShowDef =
+    { "toscaSlaveMemShow", 1, (const iocshArg *[]) {
+    &(iocshArg) { "level", iocshArgInt },
+}};
+
+static void toscaSlaveMemShowFunc(const iocshArgBuf *args)
+{
+    toscaSlaveMemShow(args[0].ival);
+}
+
 static const iocshFuncDef toscaReadDef =
     { "toscaRead", 1, (const iocshArg *[]) {
     &(iocshArg) { "[device:]addrspace:address", iocshArgString },
@@ -504,6 +678,13 @@ void toscaIntrShow(int level)
         delta = count - prevIntrTotalCount;
         prevIntrTotalCount = count;
         printf("total number of interrupts: %llu (+%llu)\n", count, delta);
+        if (toscaIntrWorkersRunning())
+        {
+            toscaIntrWorkerStats_t stats;
+            toscaIntrGetWorkerStats(&stats);
+            printf("%d interrupt workers: queued %llu, dropped %llu, queue depth %u (max %u of %u)\n",
+                toscaIntrWorkersRunning(), stats.queued, stats.dropped, stats.depth, stats.maxDepth, stats.size);
+        }
         toscaIntrForEachHandler(toscaIntrPrintInfo, &level);
         rep = 1;
         epicsTimeAddSeconds(&sched, -level);
@@ -862,6 +1043,11 @@ static void toscaIocshRegistrar(void)
     iocshRegister(&toscaMapShowDef, toscaMapShowFunc);
     iocshRegister(&toscaMapFindDef, toscaMapFindFunc);
     iocshRegister(&toscaGetVmeErrDef, toscaGetVmeErrFunc);
+    iocshRegister(&toscaVmeErrMonitorDef, toscaVmeErrMonitorFunc);
+    iocshRegister(&toscaVmeErrShowDef, toscaVmeErrShowFunc);
+    iocshRegister(&toscaVmeScanDef, toscaVmeScanFunc);
+    iocshRegister(&toscaSlaveMemWindowDef, toscaSlaveMemWindowFunc);
+    iocshRegister(&toscaSlaveMemShowDef, toscaSlaveMemShowFunc);
     iocshRegister(&toscaReadDef, toscaReadFunc);
     iocshRegister(&toscaWriteDef, toscaWriteFunc);
     iocshRegister(&toscaSetDef, toscaSetFunc);
@@ -898,4 +1084,7 @@ epicsExportAddress(int, toscaMapDebug);
 epicsExportAddress(int, toscaIntrDebug);
 epicsExportAddress(int, toscaDmaDebug);
 epicsExportAddress(int, toscaRegDebug);
+epicsExportAddress(int, toscaVmeErrDebug);
+epicsExportAddress(int, toscaSlaveMemDebug);
+epicsExportAddress(int, toscaMapReadAhead);
 
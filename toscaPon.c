@@ -1,7 +1,9 @@
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
 
 #include <epicsTypes.h>
+#include <epicsMutex.h>
 
 #include <regDev.h>
 
@@ -15,14 +17,46 @@
 #define TOSCA_DEBUG_NAME toscaReg
 #include "toscaDebug.h"
 
+epicsExportAddress(int, toscaPonDirect);
+
+#define PON_REGS 11
+static const unsigned int toscaPonAddresses[PON_REGS] =
+    { 0x00, 0x04, 0x08, 0x0c, 0x10, 0x14, 0x18, 0x1c, 0x20, 0x24, 0x40 };
+
+/* Without direct access, reads are served from a snapshot of all
+   registers which is refreshed in one pass when older than maxAge.
+*/
 struct regDevice
 {
-    int dummy;
+    epicsMutexId lock;
+    unsigned int maxAge;  /* ms */
+    uint64_t time;        /* ns, 0 if invalid */
+    unsigned int value[PON_REGS];
+    unsigned long hits, refreshes;
 };
 
-void toscaPonDevReport(regDevice *device __attribute__((unused)), int level __attribute__((unused)))
+static uint64_t toscaPonNow(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static unsigned int toscaPonIndex(size_t offset)
+{
+    if (offset == 0x40) return 10;
+    if (offset < 0x28) return offset >> 2;
+    return PON_REGS; /* invalid */
+}
+
+void toscaPonDevReport(regDevice *device, int level)
 {
-    printf("Tosca PON\n");
+    printf("Tosca PON %s", toscaPonDirectAccess() ? "memory mapped" : "sysfs");
+    if (!toscaPonDirectAccess() && device->maxAge)
+        printf(" snapshot max age %u ms", device->maxAge);
+    printf("\n");
+    if (level > 0 && device->maxAge)
+        printf("       %lu snapshot hits, %lu refreshes\n", device->hits, device->refreshes);
 }
 
 int toscaPonDevRead(
@@ -48,6 +82,39 @@ int toscaPonDevRead(
         error("%s %s: offset must be multiple of 4", user, regDevName(device));
         return -1;
     }
+    if (device->maxAge && !toscaPonDirectAccess())
+    {
+        uint64_t now = toscaPonNow();
+        int status = 0;
+
+        for (i = 0; i < nelem; i++)
+            if (toscaPonIndex(offset+(i<<2)) == PON_REGS)
+            {
+                error("%s %s: no PON register at 0x%zx", user, regDevName(device), offset+(i<<2));
+                return -1;
+            }
+
+        epicsMutexMustLock(device->lock);
+        if (!device->time || now - device->time > device->maxAge * 1000000ULL)
+        {
+            device->time = 0;
+            status = toscaPonReadList(PON_REGS, toscaPonAddresses, device->value);
+            if (status == 0)
+            {
+                device->time = now;
+                device->refreshes++;
+            }
+        }
+        else
+            device->hits++;
+        if (status == 0)
+            for (i = 0; i < nelem; i++)
+                ((epicsUInt32*)pdata)[i] = device->value[toscaPonIndex(offset+(i<<2))];
+        epicsMutexUnlock(device->lock);
+        if (status != 0)
+            error("%s %s: reading PON registers failed: %m", user, regDevName(device));
+        return status;
+    }
     for (i = 0; i < nelem; i++)
     {
         ((epicsUInt32*)pdata)[i] = toscaPonRead(offset+(i<<2));
@@ -91,6 +158,13 @@ int toscaPonDevWrite(
         {
             toscaPonWrite(offset+(i<<2), ((epicsUInt32*)pdata)[i]);
         }
+    if (device->maxAge)
+    {
+        /* make the next read see the new value */
+        epicsMutexMustLock(device->lock);
+        device->time = 0;
+        epicsMutexUnlock(device->lock);
+    }
     return 0;
 }
 
@@ -100,21 +174,23 @@ struct regDevSupport toscaPonDevRegDev = {
     .write = toscaPonDevWrite,
 };
 
-int toscaPonDevConfigure(const char* name)
+int toscaPonDevConfigure(const char* name, unsigned int maxAge)
 {
     regDevice *device = NULL;
     
     if (!name || !name[0])
     {
-        printf("usage: toscaPonDevConfigure name\n");
+        printf("usage: toscaPonDevConfigure name [maxAge]\n");
         return -1;
     }
-    device = malloc(sizeof(regDevice));
+    device = calloc(1, sizeof(regDevice));
     if (!device)
     {
         fprintf(stderr, "malloc regDevice failed: %m\n");
         return -1;
     }
+    device->lock = epicsMutexMustCreate();
+    device->maxAge = maxAge;
     errno = 0;
     if (regDevRegisterDevice(name, &toscaPonDevRegDev, device, 0x44) != SUCCESS)
     {
@@ -122,7 +198,8 @@ int toscaPonDevConfigure(const char* name)
         free(device);
         return -1;
     }
-    if (regDevInstallWorkQueue(device, 100) != SUCCESS)
+    /* memory mapped access is fast enough to be done synchronously */
+    if (!toscaPonDirectAccess() && regDevInstallWorkQueue(device, 100) != SUCCESS)
     {
         fprintf(stderr, "regDevInstallWorkQueue() failed: %m\n");
         return -1;
@@ -131,13 +208,57 @@ int toscaPonDevConfigure(const char* name)
 }
 
 static const iocshFuncDef toscaPonDevConfigureDef =
-    { "toscaPonDevConfigure", 1, (const iocshArg *[]) {
+    { "toscaPonDevConfigure", 2, (const iocshArg *[]) {
     &(iocshArg) { "name", iocshArgString },
+    &(iocshArg) { "maxAge (ms, snapshot for sysfs access)", iocshArgInt },
 }};
 
 static void toscaPonDevConfigureFunc(const iocshArgBuf *args)
 {
-    toscaPonDevConfigure(args[0].sval);
+    toscaPonDevConfigure(args[0].sval, args[1].ival);
+}
+
+static const iocshFuncDef toscaPonBenchmarkDef =
+    { "toscaPonBenchmark", 1, (const iocshArg *[]) {
+    &(iocshArg) { "loops", iocshArgInt },
+}};
+
+static double toscaPonBenchmarkRun(unsigned int loops, int list)
+{
+    struct timespec start, finished;
+    unsigned int values[PON_REGS];
+    unsigned int i, j;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    for (i = 0; i < loops; i++)
+    {
+        if (list)
+            toscaPonReadList(PON_REGS, toscaPonAddresses, values);
+        else
+            for (j = 0; j < PON_REGS; j++)
+                values[j] = toscaPonRead(toscaPonAddresses[j]);
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &finished);
+    return ((finished.tv_sec - start.tv_sec) * 1e6 + (finished.tv_nsec - start.tv_nsec) * 1e-3) / loops / PON_REGS;
+}
+
+static void toscaPonBenchmarkFunc(const iocshArgBuf *args)
+{
+    unsigned int loops = args[0].ival > 0 ? args[0].ival : 1000;
+    int direct = toscaPonDirect;
+
+    /* Temporarily switches other users of the PON registers to sysfs as well. */
+    toscaPonDirect = 0;
+    printf("sysfs          %8.3f usec/register\n", toscaPonBenchmarkRun(loops, 0));
+    printf("sysfs list     %8.3f usec/register\n", toscaPonBenchmarkRun(loops, 1));
+    toscaPonDirect = direct;
+    if (toscaPonDirectAccess())
+    {
+        printf("mapped         %8.3f usec/register\n", toscaPonBenchmarkRun(loops, 0));
+        printf("mapped list    %8.3f usec/register\n", toscaPonBenchmarkRun(loops, 1));
+    }
+    else
+        printf("no memory map available\n");
 }
 
 static const iocshFuncDef toscaPonReadDef =
@@ -227,6 +348,7 @@ static void toscaPonClearFunc(const iocshArgBuf *args)
 static void toscaPonRegistrar(void)
 {
     iocshRegister(&toscaPonDevConfigureDef, toscaPonDevConfigureFunc);
+    iocshRegister(&toscaPonBenchmarkDef, toscaPonBenchmarkFunc);
     iocshRegister(&toscaPonReadDef, toscaPonReadFunc);
     iocshRegister(&toscaPonWriteDef, toscaPonWriteFunc);
     iocshRegister(&toscaPonWriteMaskedDef, toscaPonWriteMaskedFunc);
@@ -1,11 +1,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 
 #include <epicsExit.h>
 #include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <epicsMessageQueue.h>
 #include <ellLib.h>
 #include <dbAccess.h>
+#include <dbStaticLib.h>
 #include <iocsh.h>
 #include <epicsStdioRedirect.h>
 
@@ -29,26 +34,181 @@ typedef uint64_t __u64;
 #include "toscaDebug.h"
 epicsExportAddress(int, toscaRegDevDebug);
 
+int toscaRegDevPioWorkers = 2;
+epicsExportAddress(int, toscaRegDevPioWorkers);
+
 #define TOSCA_MAGIC 4009480706U /* crc("Tosca") */
 
+/* Transfer statistics, also the memory layout of the statistics device.
+   All counters are 32 bit and wrap around.
+   Latency histogram bin i counts transfers faster than 2^i us,
+   the last bin counts all slower ones.
+*/
+#define TOSCA_REGDEV_HIST_BINS 16
+
+struct toscaRegDevPathStats {
+    epicsUInt32 count;
+    epicsUInt32 bytes;
+    epicsUInt32 errors;
+    epicsUInt32 hist[TOSCA_REGDEV_HIST_BINS];
+};
+
+struct toscaRegDevStats {
+    struct toscaRegDevPathStats pioRead, pioWrite, dmaRead, dmaWrite;
+    epicsUInt32 interrupts;
+};
+
 struct regDevice
 {
     unsigned int magic;
     const char* name;
     size_t baseaddr;
+    size_t size;
     volatile void* baseptr;
     unsigned int dmaReadLimit;
     unsigned int dmaWriteLimit;
     unsigned int addrspace;
     unsigned int dmaSpace;
     unsigned int swap;
+    unsigned int wideRead;
     int ivec;
+    unsigned int intrRate;
+    unsigned int mergeWindow;
+    size_t pioAsyncLimit;
+    int dmaTimeout;
+    epicsMutexId recordsLock;
+    struct toscaRegDevRecord* records;
+    struct toscaRegDevMerge* merge;
+    struct toscaRegDevPingPong* pingpong;
+    struct toscaRegDevCache* cache;
+    struct toscaRegDevBatch* batch;
+    struct toscaRegDevStats stats;
     IOSCANPVT ioscanpvt[256];
 };
 
+/* Per record DMA timeout on asynchronous DMA */
+struct toscaRegDevRecord {
+    const char* user;
+    int timeout;
+    struct toscaRegDevRecord* next;
+};
+
+struct toscaRegDevMergeRequest {
+    size_t offset;
+    unsigned int dlen;
+    size_t nelem;
+    void* pdata;
+    regDevTransferComplete callback;
+    const char* user;
+};
+
+struct toscaRegDevMerge {
+    epicsMutexId lock;
+    epicsEventId wakeup;
+    struct toscaRegDevMergeRequest* requests; /* the merge thread takes it over */
+    size_t count, capacity;
+    void* shadow;
+    size_t shadowSize;
+    unsigned long long merged, transfers;
+};
+
+struct toscaRegDevBatchEntry {
+    size_t offset;
+    unsigned int dlen;
+    size_t nelem;
+    int masked;
+    uint64_t mask;
+    /* followed by data, padded to 8 bytes */
+};
+
+#define TOSCA_REGDEV_BATCH_ENTRY_SIZE(size) (sizeof(struct toscaRegDevBatchEntry) + (((size) + 7) & ~7))
+
+struct toscaRegDevBatch {
+    epicsMutexId lock;
+    epicsEventId wakeup;
+    char* log;
+    void* staging;
+    size_t used, threshold;
+    unsigned int delay, maxAge;
+    int readback;
+    unsigned long long writes, transfers;
+};
+
+#define TOSCA_REGDEV_CACHE_RANGES 16
+
+struct toscaRegDevCacheRange {
+    size_t start, end;
+    volatile int valid;
+    volatile unsigned int generation;
+    uint64_t loaded;
+};
+
+struct toscaRegDevCache {
+    epicsMutexId lock;
+    volatile void* shadow;
+    unsigned int maxAge;
+    int index;
+    unsigned int count;
+    struct toscaRegDevCacheRange ranges[TOSCA_REGDEV_CACHE_RANGES];
+    unsigned long long hits, misses, invalidations;
+};
+
+struct toscaRegDevPingPong {
+    void* buffer[2];
+    struct dmaRequest* request[2];
+    volatile int active;
+    volatile int readers[2];
+    int status;
+    int index;
+    size_t size;
+    unsigned long long swaps, errors, overruns;
+};
+
 #define VME_DMA_MODES (VME_BLT|VME_MBLT|VME_2eVME|VME_2eSST160|VME_2eSST267|VME_2eSST320)
 
-void toscaRegDevReport(regDevice *device, int level __attribute__((unused)))
+static uint64_t toscaRegDevNow(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* Counts a transfer, start = 0 for asynchronous transfers (no latency) */
+static void toscaRegDevCount(struct toscaRegDevPathStats* stats, size_t bytes, int status, uint64_t start)
+{
+    __sync_fetch_and_add(&stats->count, 1);
+    __sync_fetch_and_add(&stats->bytes, bytes);
+    if (status != SUCCESS && status != ASYNC_COMPLETION)
+        __sync_fetch_and_add(&stats->errors, 1);
+    if (start)
+    {
+        uint64_t us = (toscaRegDevNow() - start) / 1000;
+        int bin = 0;
+        while (us && bin < TOSCA_REGDEV_HIST_BINS - 1)
+        {
+            us >>= 1;
+            bin++;
+        }
+        __sync_fetch_and_add(&stats->hist[bin], 1);
+    }
+}
+
+static void toscaRegDevReportPath(const char* name, const struct toscaRegDevPathStats* stats)
+{
+    int bin, last;
+
+    if (!stats->count) return;
+    printf("    %-9s %u transfers, %u bytes, %u errors\n",
+        name, stats->count, stats->bytes, stats->errors);
+    for (last = TOSCA_REGDEV_HIST_BINS - 1; last > 0 && !stats->hist[last]; last--);
+    printf("              latency:");
+    for (bin = 0; bin <= last; bin++)
+        printf(" %s%uus:%u", bin == TOSCA_REGDEV_HIST_BINS - 1 ? ">=" : "<",
+            1U << (bin == TOSCA_REGDEV_HIST_BINS - 1 ? bin - 1 : bin), stats->hist[bin]);
+    printf("\n");
+}
+
+void toscaRegDevReport(regDevice *device, int level)
 {
     printf("Tosca %s%s%s:0x%zx",
         device->baseptr ? toscaAddrSpaceToStr(device->addrspace) : "",
@@ -64,7 +224,477 @@ void toscaRegDevReport(regDevice *device, int level __attribute__((unused)))
         printf(", no DMA");
     if (device->dmaReadLimit > 1 || device->dmaWriteLimit > 1)
         printf(", DMA R/W limit=%u/%u", device->dmaReadLimit, device->dmaWriteLimit);
+    if (device->wideRead)
+        printf(", wide reads");
+    if (device->intrRate)
+        printf(", intrRate=%u/s", device->intrRate);
+    if (device->dmaTimeout)
+        printf(", DMA timeout %dms", device->dmaTimeout);
+    if (device->pioAsyncLimit)
+        printf(", async PIO from %zu bytes", device->pioAsyncLimit);
+    if (device->cache)
+    {
+        printf(", cache %u range%s", device->cache->count, device->cache->count == 1 ? "" : "s");
+        if (device->cache->maxAge)
+            printf(" max age %ums", device->cache->maxAge);
+        if (device->cache->index >= 0)
+            printf(" intr %d", device->ivec);
+        printf(" (%llu hits, %llu misses, %llu invalidations)",
+            device->cache->hits, device->cache->misses, device->cache->invalidations);
+    }
+    if (device->batch)
+        printf(", write batch %zu bytes %u/%ums%s (%llu writes in %llu transfers)",
+            device->batch->threshold, device->batch->delay, device->batch->maxAge,
+            device->batch->readback ? " readback" : "", device->batch->writes, device->batch->transfers);
+    if (device->merge)
+        printf(", read merge window=%uus (%llu reads in %llu transfers)",
+            device->mergeWindow, device->merge->merged, device->merge->transfers);
+    if (device->pingpong)
+        printf(", ping-pong on intr %d (%llu swaps, %llu errors, %llu overruns)",
+            device->ivec, device->pingpong->swaps, device->pingpong->errors, device->pingpong->overruns);
     printf("\n");
+    if (level > 0)
+    {
+        toscaRegDevReportPath("PIO read", &device->stats.pioRead);
+        toscaRegDevReportPath("PIO write", &device->stats.pioWrite);
+        toscaRegDevReportPath("DMA read", &device->stats.dmaRead);
+        toscaRegDevReportPath("DMA write", &device->stats.dmaWrite);
+        if (device->stats.interrupts)
+            printf("    %u interrupts\n", device->stats.interrupts);
+    }
+}
+
+/* Read merging:
+   Asynchronous reads arriving within mergeWindow microseconds are collected. Overlapping and adjacent ranges are
+   read with one DMA or one PIO burst into a shadow buffer from which all
+   requesters are completed.
+*/
+
+static int toscaRegDevMergeCompare(const void* a, const void* b)
+{
+    size_t oa = ((const struct toscaRegDevMergeRequest*)a)->offset;
+    size_t ob = ((const struct toscaRegDevMergeRequest*)b)->offset;
+    return oa < ob ? -1 : oa > ob;
+}
+
+/* Reads [*start, end) into the shadow buffer, may move *start down for alignment.
+   Like single reads, uses DMA from dmaReadLimit elements of size dlen on. */
+static int toscaRegDevMergeTransfer(regDevice *device, size_t* start, size_t end, unsigned int dlen)
+{
+    struct toscaRegDevMerge* merge = device->merge;
+    size_t size = end - *start;
+    int dma = device->dmaReadLimit && (size / dlen >= device->dmaReadLimit || !device->baseptr);
+
+    if (dma)
+    {
+        /* DMA needs 8 byte alignment, but must not leave the device */
+        size_t misalignment = (device->baseaddr + *start) & 7;
+        size_t dmasize = (size + misalignment + 7) & ~7;
+        if (*start >= misalignment && *start - misalignment + dmasize <= device->size)
+        {
+            *start -= misalignment;
+            size = dmasize;
+        }
+        else if (device->baseptr)
+            dma = 0;
+        else
+        {
+            error("%s: cannot DMA 0x%zx-0x%zx with 8 byte alignment within device",
+                device->name, *start, end);
+            return -1;
+        }
+    }
+    if (size > merge->shadowSize)
+    {
+        toscaDmaFree(merge->shadow);
+        merge->shadowSize = 0;
+        if (!(merge->shadow = toscaDmaAlloc(size)))
+        {
+            error("%s: cannot allocate shadow buffer of 0x%zx bytes", device->name, size);
+            return -1;
+        }
+        merge->shadowSize = size;
+    }
+    merge->transfers++;
+    if (dma)
+    {
+        uint64_t t0 = toscaRegDevNow();
+        int status;
+        debugLvl(2, "%s: DMA 0x%zx-0x%zx", device->name, *start, *start + size);
+        status = toscaDmaRead(device->dmaSpace, device->baseaddr + *start, merge->shadow, size, 0,
+            device->dmaTimeout, NULL, NULL);
+        toscaRegDevCount(&device->stats.dmaRead, size, status, t0);
+        return status;
+    }
+    else
+    {
+        uint64_t t0 = toscaRegDevNow();
+        debugLvl(2, "%s: PIO 0x%zx-0x%zx", device->name, *start, *start + size);
+        if (device->wideRead)
+            toscaMapCopyFrom(merge->shadow, device->baseptr + *start, size, 0);
+        else
+        {
+            /* like single reads, element wise (narrower if the merged range is not aligned) */
+            while (dlen > 1 && ((*start | size) & (dlen - 1))) dlen >>= 1;
+            regDevCopy(dlen, size / dlen, device->baseptr + *start, merge->shadow, NULL, REGDEV_NO_SWAP);
+        }
+        toscaRegDevCount(&device->stats.pioRead, size, SUCCESS, t0);
+        return 0;
+    }
+}
+
+static void toscaRegDevMergeProcess(regDevice *device, struct toscaRegDevMergeRequest* requests, size_t count)
+{
+    size_t first, last, i, start, end;
+    int status;
+
+    qsort(requests, count, sizeof(*requests), toscaRegDevMergeCompare);
+    for (first = 0; first < count; first = last)
+    {
+        start = requests[first].offset;
+        end = start + requests[first].nelem * requests[first].dlen;
+        for (last = first + 1; last < count && requests[last].offset <= end; last++)
+        {
+            if (requests[last].offset + requests[last].nelem * requests[last].dlen > end)
+                end = requests[last].offset + requests[last].nelem * requests[last].dlen;
+        }
+        debugLvl(2, "%s: %zu requests merged to 0x%zx-0x%zx", device->name, last - first, start, end);
+        device->merge->merged += last - first;
+        status = toscaRegDevMergeTransfer(device, &start, end, requests[first].dlen);
+        for (i = first; i < last; i++)
+        {
+            struct toscaRegDevMergeRequest* r = &requests[i];
+            if (status == 0)
+            {
+                volatile void* src = device->merge->shadow + (r->offset - start);
+                if (device->swap)
+                    regDevCopy(device->swap, r->nelem * r->dlen / device->swap, src, r->pdata, NULL, REGDEV_DO_SWAP);
+                else
+                    regDevCopy(r->dlen, r->nelem, src, r->pdata, NULL, REGDEV_NO_SWAP);
+            }
+            r->callback(r->user, status);
+        }
+    }
+}
+
+static void toscaRegDevMergeThread(regDevice *device)
+{
+    struct toscaRegDevMerge* merge = device->merge;
+    struct toscaRegDevMergeRequest* requests;
+    size_t count;
+
+    while (1)
+    {
+        epicsEventMustWait(merge->wakeup);
+        epicsThreadSleep(device->mergeWindow * 1e-6);
+        /* Take over the collected requests. New requests go to a new array. */
+        epicsMutexMustLock(merge->lock);
+        requests = merge->requests;
+        count = merge->count;
+        merge->requests = NULL;
+        merge->count = 0;
+        merge->capacity = 0;
+        epicsMutexUnlock(merge->lock);
+        if (count) toscaRegDevMergeProcess(device, requests, count);
+        free(requests);
+    }
+}
+
+static int toscaRegDevMergeInit(regDevice *device)
+{
+    struct toscaRegDevMerge* merge;
+    char name[32];
+
+    if (!(merge = calloc(1, sizeof(struct toscaRegDevMerge))))
+        return -1;
+    merge->lock = epicsMutexMustCreate();
+    merge->wakeup = epicsEventMustCreate(epicsEventEmpty);
+    device->merge = merge;
+    sprintf(name, "merge-%.24s", device->name);
+    if (!epicsThreadCreate(name, epicsThreadPriorityHigh,
+        epicsThreadGetStackSize(epicsThreadStackSmall),
+        (EPICSTHREADFUNC)toscaRegDevMergeThread, device))
+    {
+        device->merge = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Returns 0 if request cannot be merged */
+static int toscaRegDevMergeRead(regDevice *device, size_t offset, unsigned int dlen, size_t nelem,
+    void* pdata, regDevTransferComplete callback, const char* user)
+{
+    struct toscaRegDevMerge* merge = device->merge;
+    size_t count;
+
+    if (device->swap && ((device->baseaddr + offset) % device->swap || (nelem * dlen) % device->swap))
+        return 0;
+    epicsMutexMustLock(merge->lock);
+    if (merge->count == merge->capacity)
+    {
+        size_t capacity = merge->capacity ? 2 * merge->capacity : 64;
+        struct toscaRegDevMergeRequest* requests;
+        /* merge->requests is never the array the merge thread is processing */
+        requests = realloc(merge->requests, capacity * sizeof(*requests));
+        if (!requests)
+        {
+            epicsMutexUnlock(merge->lock);
+            return 0;
+        }
+        merge->requests = requests;
+        merge->capacity = capacity;
+    }
+    merge->requests[merge->count++] = (struct toscaRegDevMergeRequest)
+        { offset, dlen, nelem, pdata, callback, user };
+    count = merge->count;
+    epicsMutexUnlock(merge->lock);
+    debugLvl(3, "%s: %s queued offset=0x%zx size=0x%zx", device->name, user, offset, nelem * dlen);
+    if (count == 1) epicsEventSignal(merge->wakeup);
+    return 1;
+}
+
+/* Asynchronous PIO:
+   Memory mapped transfers of at least pioAsyncLimit bytes from records
+   which accept asynchronous completion are passed to a pool of worker
+   threads to free the scan thread. If the queue is full, the transfer
+   is done synchronously.
+*/
+
+struct toscaRegDevPioJob {
+    regDevice *device;
+    size_t offset;
+    unsigned int dlen;
+    size_t nelem;
+    void* pdata;
+    void* pmask;
+    int priority;
+    int write;
+    regDevTransferComplete callback;
+    const char* user;
+};
+
+static epicsMessageQueueId toscaRegDevPioQueue;
+
+static int toscaRegDevPioOffload(regDevice *device, size_t offset, unsigned int dlen, size_t nelem,
+    void* pdata, void* pmask, int priority, int write, regDevTransferComplete callback, const char* user)
+{
+    struct toscaRegDevPioJob job = {
+        device, offset, dlen, nelem, pdata, pmask, priority, write, callback, user };
+
+    if (epicsMessageQueueTrySend(toscaRegDevPioQueue, &job, sizeof(job)) != 0)
+    {
+        debugLvl(2, "%s: PIO queue full, transfer synchronously", user);
+        return -1;
+    }
+    return 0;
+}
+
+/* Memory mapped read (from map or shadow buffer at base) with swapping */
+static int toscaRegDevCopyFrom(regDevice *device, volatile void* base,
+    size_t offset, unsigned int dlen, size_t nelem, void* pdata)
+{
+    if (device->swap) {
+        size_t words;
+        size_t misalignment = (device->baseaddr + offset) % device->swap;
+        if (misalignment)
+        {
+            size_t len;
+            char tmp[8];
+            if (device->swap > 8) {
+                debug("cannot handle misalignment with swap > 8");
+                return -1;
+            }
+            len = device->swap - misalignment;
+            if (len > nelem * dlen) len = nelem * dlen;
+            offset -= misalignment;
+            regDevCopy(device->swap, 1, base + offset, tmp, NULL, REGDEV_DO_SWAP);
+            memcpy(pdata, tmp + misalignment, len);
+            offset += device->swap;
+            pdata += misalignment;
+        }
+        words = (nelem * dlen - misalignment) / device->swap;
+        if (words > 1 && device->wideRead)
+            toscaMapCopyFrom(pdata, base + offset, words * device->swap, device->swap);
+        else if (words)
+            regDevCopy(device->swap, words, base + offset, pdata, NULL, REGDEV_DO_SWAP);
+
+    }
+    else if (nelem > 1 && device->wideRead)
+        toscaMapCopyFrom(pdata, base + offset, nelem * dlen, 0);
+    else
+        regDevCopy(dlen, nelem, base + offset, pdata, NULL, REGDEV_NO_SWAP);
+    return SUCCESS;
+}
+
+/* Read-through cache:
+   Reads completely inside one of the declared ranges are served from a
+   shadow buffer. A miss loads the whole range. Ranges are invalidated by
+   overlapping writes, by the cache interrupt or after maxAge ms.
+   A generation counter prevents marking a range valid if it has been
+   invalidated while loading.
+*/
+
+static int toscaRegDevCacheAddRange(regDevice *device, size_t start, size_t size)
+{
+    struct toscaRegDevCache* cache = device->cache;
+
+    if (!cache)
+    {
+        if (!(cache = calloc(1, sizeof(struct toscaRegDevCache)))) return -1;
+        cache->index = -1;
+        device->cache = cache;
+    }
+    if (cache->count == TOSCA_REGDEV_CACHE_RANGES)
+    {
+        error("%s: too many cache ranges, max %d", device->name, TOSCA_REGDEV_CACHE_RANGES);
+        return -1;
+    }
+    /* whole 32 bit registers */
+    cache->ranges[cache->count].start = start & ~3;
+    cache->ranges[cache->count].end = size ? (start + size + 3) & ~3 : (size_t)-1;
+    cache->count++;
+    return 0;
+}
+
+static int toscaRegDevCacheRead(regDevice *device, size_t offset, unsigned int dlen, size_t nelem, void* pdata)
+{
+    struct toscaRegDevCache* cache = device->cache;
+    struct toscaRegDevCacheRange* r;
+    size_t end = offset + nelem * dlen;
+    unsigned int i, generation;
+    uint64_t now;
+    int status;
+
+    for (i = 0; i < cache->count; i++)
+    {
+        r = &cache->ranges[i];
+        if (offset >= r->start && end <= r->end) break;
+    }
+    if (i == cache->count) return 1; /* not cacheable */
+
+    epicsMutexLock(cache->lock);
+    now = toscaRegDevNow();
+    if (r->valid && cache->maxAge && now - r->loaded >= cache->maxAge * 1000000ULL)
+        r->valid = 0;
+    if (r->valid)
+        cache->hits++;
+    else
+    {
+        generation = r->generation;
+        debugLvl(2, "%s: load cache 0x%zx-0x%zx", device->name, r->start, r->end);
+        if (device->wideRead)
+            toscaMapCopyFrom((void*)(cache->shadow + r->start), device->baseptr + r->start, r->end - r->start, 0);
+        else
+            regDevCopy(4, (r->end - r->start) / 4, device->baseptr + r->start, cache->shadow + r->start, NULL, REGDEV_NO_SWAP);
+        toscaRegDevCount(&device->stats.pioRead, r->end - r->start, SUCCESS, now);
+        __sync_synchronize();
+        if (generation == r->generation)
+        {
+            r->loaded = now;
+            r->valid = 1;
+        }
+        cache->misses++;
+    }
+    status = toscaRegDevCopyFrom(device, cache->shadow, offset, dlen, nelem, pdata);
+    epicsMutexUnlock(cache->lock);
+    return status;
+}
+
+/* Returns 1 if any cached range overlaps */
+static int toscaRegDevCacheInvalidate(regDevice *device, size_t offset, size_t size)
+{
+    struct toscaRegDevCache* cache = device->cache;
+    unsigned int i;
+    int hit = 0;
+
+    for (i = 0; i < cache->count; i++)
+    {
+        struct toscaRegDevCacheRange* r = &cache->ranges[i];
+        if (offset < r->end && offset + size > r->start)
+        {
+            __sync_fetch_and_add(&r->generation, 1);
+            r->valid = 0;
+            hit = 1;
+        }
+    }
+    if (hit) cache->invalidations++;
+    return hit;
+}
+
+static int toscaRegDevCacheInit(regDevice *device, size_t size)
+{
+    struct toscaRegDevCache* cache = device->cache;
+    toscaMapInfo_t map;
+    size_t limit;
+    unsigned int i;
+    void* buffer;
+
+    if (!device->baseptr)
+    {
+        error("%s: cache needs a memory map", device->name);
+        errno = EINVAL;
+        return -1;
+    }
+    /* ranges are refreshed in 32 bit words, round the device end up within the map */
+    map = toscaMapFind(device->baseptr);
+    limit = (size + 3) & ~3;
+    if (map.addrspace && limit > map.size - (size_t)((volatile char*)device->baseptr - (volatile char*)map.baseptr))
+    {
+        error("%s: cache needs a device size multiple of 4", device->name);
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < cache->count; i++)
+    {
+        if (cache->ranges[i].end > limit) cache->ranges[i].end = limit;
+        if (cache->ranges[i].start >= cache->ranges[i].end)
+        {
+            error("%s: cache range 0x%zx outside device", device->name, cache->ranges[i].start);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if (!(cache->lock = epicsMutexCreate())) return -1;
+    /* shadow has same alignment as device */
+    if (!(buffer = valloc(limit + 8))) return -1;
+    cache->shadow = buffer + (device->baseaddr & 7);
+    return 0;
+}
+
+static void toscaRegDevBatchFlush(regDevice *device);
+
+/* Finds the entry of the record (user is the record name) for asynchronous DMA.
+   The DMA timeout is the device dmaTimeout unless the record has an
+   info(toscaDmaTimeout, "ms") tag. An expired transfer completes with
+   ETIMEDOUT through the regDev callback, and the record raises its alarm
+   when it processes the result.
+*/
+static struct toscaRegDevRecord* toscaRegDevRecordFind(regDevice *device, const char* user)
+{
+    struct toscaRegDevRecord* rec;
+
+    epicsMutexMustLock(device->recordsLock);
+    for (rec = device->records; rec; rec = rec->next)
+        if (rec->user == user) break;
+    if (!rec && (rec = calloc(1, sizeof(struct toscaRegDevRecord))) != NULL)
+    {
+        DBENTRY entry;
+        const char* info;
+
+        rec->user = user;
+        rec->timeout = device->dmaTimeout;
+        dbInitEntry(pdbbase, &entry);
+        if (dbFindRecord(&entry, user) == 0 &&
+            (info = dbGetInfo(&entry, "toscaDmaTimeout")) != NULL)
+            rec->timeout = strtol(info, NULL, 0);
+        dbFinishEntry(&entry);
+        debug("%s: %s DMA timeout %d ms", device->name, user, rec->timeout);
+        rec->next = device->records;
+        device->records = rec;
+    }
+    epicsMutexUnlock(device->recordsLock);
+    return rec;
 }
 
 int toscaRegDevRead(
@@ -73,10 +703,13 @@ int toscaRegDevRead(
     unsigned int dlen,
     size_t nelem,
     void* pdata,
-    int priority __attribute__((unused)),
+    int priority,
     regDevTransferComplete callback,
     const char* user)
 {
+    uint64_t t0;
+    int status;
+
     if (!device || device->magic != TOSCA_MAGIC)
     {
         debug("buggy device handle");
@@ -86,14 +719,54 @@ int toscaRegDevRead(
         device->name, offset, dlen, nelem, device->dmaReadLimit, user);
     if (!nelem || !dlen) return SUCCESS;
 
+    if (device->batch && device->batch->used)
+        toscaRegDevBatchFlush(device); /* read after write */
+    t0 = toscaRegDevNow();
+    if (device->cache && (status = toscaRegDevCacheRead(device, offset, dlen, nelem, pdata)) <= 0)
+        return status;
+    if (device->pingpong)
+    {
+        /* read the last complete snapshot, DMA has already swapped */
+        struct toscaRegDevPingPong* pingpong = device->pingpong;
+        int active;
+        if (pingpong->status)
+        {
+            errno = pingpong->status;
+            debug("%s: %s last ping-pong DMA failed: %m", user, device->name);
+            toscaRegDevCount(&device->stats.pioRead, 0, -1, 0);
+            return -1;
+        }
+        /* claim the buffer, the handler does not DMA into a buffer with readers */
+        while (1)
+        {
+            active = pingpong->active;
+            __sync_fetch_and_add(&pingpong->readers[active], 1);
+            if (active == pingpong->active) break;
+            __sync_fetch_and_sub(&pingpong->readers[active], 1);
+        }
+        regDevCopy(dlen, nelem, pingpong->buffer[active] + offset, pdata, NULL, REGDEV_NO_SWAP);
+        __sync_fetch_and_sub(&pingpong->readers[active], 1);
+        toscaRegDevCount(&device->stats.pioRead, nelem*dlen, SUCCESS, t0);
+        return SUCCESS;
+    }
+
+    if (device->merge && callback &&
+        toscaRegDevMergeRead(device, offset, dlen, nelem, pdata, callback, user))
+        return ASYNC_COMPLETION;
+
     if (device->dmaReadLimit && nelem >= device->dmaReadLimit)
     {
         char* fname;
         void* usr = (void*)user;
+        int timeout = device->dmaTimeout;
+        struct toscaRegDevRecord* rec;
 
         assert(device->dmaSpace != 0);
-        int status = toscaDmaRead(device->dmaSpace, device->baseaddr + offset, pdata, nelem*dlen,
-            device->swap, 0, (toscaDmaCallback)callback, usr);
+        if (callback && (rec = toscaRegDevRecordFind(device, user)) != NULL)
+            timeout = rec->timeout;
+        status = toscaDmaRead(device->dmaSpace, device->baseaddr + offset, pdata, nelem*dlen,
+            device->swap, timeout, (toscaDmaCallback)callback, usr);
+        toscaRegDevCount(&device->stats.dmaRead, nelem*dlen, status, callback ? 0 : t0);
         if (callback != NULL && status == 0)
             return ASYNC_COMPLETION;
         if (status != 0) debugErrno("toscaDmaRead %s %s:0x%zx %s:0x%zx[0x%zx] swap=%d callback=%s(%p)",
@@ -101,52 +774,34 @@ int toscaRegDevRead(
             device->swap, fname=symbolName(callback,0), user), free(fname);
         return status;
     }
+    if (callback && device->pioAsyncLimit && nelem*dlen >= device->pioAsyncLimit &&
+        toscaRegDevPioOffload(device, offset, dlen, nelem, pdata, NULL, priority, 0, callback, user) == 0)
+        return ASYNC_COMPLETION;
     if (device->baseptr == NULL)
     {
         debug("%s: %s is not memory mapped\n", user, device->name);
         return -1;
     }
     assert(pdata != NULL);
-    if (device->swap) {
-        size_t words;
-        size_t misalignment = (device->baseaddr + offset) % device->swap;
-        if (misalignment)
-        {
-            size_t len;
-            char tmp[8];
-            if (device->swap > 8) {
-                debug("cannot handle misalignment with swap > 8");
-                return -1;
-            }
-            len = device->swap - misalignment;
-            if (len > nelem * dlen) len = nelem * dlen;
-            offset -= misalignment;
-            regDevCopy(device->swap, 1, device->baseptr + offset, tmp, NULL, REGDEV_DO_SWAP);
-            memcpy(pdata, tmp + misalignment, len);
-            offset += device->swap;
-            pdata += misalignment;
-        }
-        words = (nelem * dlen - misalignment) / device->swap;
-        if (words)
-            regDevCopy(device->swap, words, device->baseptr + offset, pdata, NULL, REGDEV_DO_SWAP);
-
-    }
-    else
-        regDevCopy(dlen, nelem, device->baseptr + offset, pdata, NULL, REGDEV_NO_SWAP);
+    if (toscaRegDevCopyFrom(device, device->baseptr, offset, dlen, nelem, pdata) != SUCCESS)
+        return -1;
+    toscaRegDevCount(&device->stats.pioRead, nelem*dlen, SUCCESS, t0);
     return SUCCESS;
 };
 
-int toscaRegDevWrite(
+static int toscaRegDevDoWrite(
     regDevice *device,
     size_t offset,
     unsigned int dlen,
     size_t nelem,
     void* pdata,
     void* pmask,
-    int priority __attribute__((unused)),
+    int priority,
     regDevTransferComplete callback,
     const char* user)
 {
+    uint64_t t0;
+
     if (!device || device->magic != TOSCA_MAGIC)
     {
         debug("buggy device handle");
@@ -155,23 +810,39 @@ int toscaRegDevWrite(
     debugLvl(2, "device=%s offset=0x%zx dlen=%u, nelem=%zu [dmaWriteLimit=%u] pmask=%p user=%s",
         device->name, offset, dlen, nelem, device->dmaWriteLimit, pmask, user);
     if (!nelem || !dlen) return SUCCESS;
+    t0 = toscaRegDevNow();
+
+    /* synchronous write for cached ranges to invalidate again after completion */
+    if (device->cache && toscaRegDevCacheInvalidate(device, offset, nelem*dlen))
+        callback = NULL;
 
     if (pmask == NULL && device->dmaWriteLimit && nelem >= device->dmaWriteLimit)
     {
         char* fname;
         void* usr = (void*)user;
+        int timeout = device->dmaTimeout;
+        struct toscaRegDevRecord* rec;
+        int status;
 
         assert(device->dmaSpace != 0);
-        int status = toscaDmaWrite(pdata, device->dmaSpace, device->baseaddr + offset, nelem*dlen,
-            device->swap, 0, (toscaDmaCallback)callback, usr);
+        if (callback && (rec = toscaRegDevRecordFind(device, user)) != NULL)
+            timeout = rec->timeout;
+        status = toscaDmaWrite(pdata, device->dmaSpace, device->baseaddr + offset, nelem*dlen,
+            device->swap, timeout, (toscaDmaCallback)callback, usr);
+        toscaRegDevCount(&device->stats.dmaWrite, nelem*dlen, status, callback ? 0 : t0);
         if (callback != NULL && status == 0)
             return ASYNC_COMPLETION;
+        if (device->cache) toscaRegDevCacheInvalidate(device, offset, nelem*dlen);
         if (status != 0) debugErrno("toscaDmaWrite %s %s:0x%zx %s:0x%zx[0x%zx] swap=%d callback=%s(%p)",
             user, device->name, offset, toscaDmaSpaceToStr(device->dmaSpace), device->baseaddr + offset, nelem*dlen,
             device->swap, fname=symbolName(callback,0), user), free(fname);
         return status;
     }
 
+    if (callback && device->pioAsyncLimit && nelem*dlen >= device->pioAsyncLimit &&
+        toscaRegDevPioOffload(device, offset, dlen, nelem, pdata, pmask, priority, 1, callback, user) == 0)
+        return ASYNC_COMPLETION;
+
     /* TODO: check alignment of offset and nelem*dlen with device->swap */
     if (pmask && dlen != device->swap) /* mask with different dlen than swap */
     {
@@ -192,9 +863,235 @@ int toscaRegDevWrite(
         regDevCopy(device->swap, nelem*dlen/device->swap, pdata, device->baseptr + offset, pmask, REGDEV_DO_SWAP);
     else
         regDevCopy(dlen, nelem, pdata, device->baseptr + offset, pmask, device->swap ? REGDEV_DO_SWAP : REGDEV_NO_SWAP);
+    toscaRegDevCount(&device->stats.pioWrite, nelem*dlen, SUCCESS, t0);
+    if (device->cache) toscaRegDevCacheInvalidate(device, offset, nelem*dlen);
     return SUCCESS;
 };
 
+/* Write batching:
+   Writes are appended to a log and complete immediately. The log is
+   written in order when it exceeds the threshold, when no further write
+   arrived within the batch delay or the oldest write reaches maxAge,
+   before any read from the device and on toscaRegDevFlush().
+   Consecutive unmasked writes to adjacent ranges with the same element
+   size are combined into one transfer, which uses DMA if it is long enough.
+   With readback, the last element of each memory mapped transfer is read
+   back to make sure the posted writes have arrived.
+*/
+
+static void toscaRegDevBatchReadback(regDevice *device, size_t offset, unsigned int dlen)
+{
+    uint64_t dummy;
+
+    if (!device->baseptr) return; /* DMA has completed anyway */
+    regDevCopy(dlen, 1, device->baseptr + offset, &dummy, NULL, REGDEV_NO_SWAP);
+}
+
+static void toscaRegDevBatchFlushLocked(regDevice *device)
+{
+    struct toscaRegDevBatch* batch = device->batch;
+    size_t pos = 0, next;
+
+    while (pos < batch->used)
+    {
+        struct toscaRegDevBatchEntry* entry = (struct toscaRegDevBatchEntry*)(batch->log + pos);
+        size_t size = entry->nelem * entry->dlen;
+
+        next = pos + TOSCA_REGDEV_BATCH_ENTRY_SIZE(size);
+        if (entry->masked)
+        {
+            toscaRegDevDoWrite(device, entry->offset, entry->dlen, entry->nelem, entry + 1, &entry->mask,
+                0, NULL, "batch");
+            if (batch->readback)
+                toscaRegDevBatchReadback(device, entry->offset + size - entry->dlen, entry->dlen);
+        }
+        else
+        {
+            size_t nelem = entry->nelem;
+
+            memcpy(batch->staging, entry + 1, size);
+            while (next < batch->used)
+            {
+                struct toscaRegDevBatchEntry* e = (struct toscaRegDevBatchEntry*)(batch->log + next);
+                size_t esize = e->nelem * e->dlen;
+
+                if (e->masked || e->dlen != entry->dlen || e->offset != entry->offset + size) break;
+                memcpy(batch->staging + size, e + 1, esize);
+                size += esize;
+                nelem += e->nelem;
+                next += TOSCA_REGDEV_BATCH_ENTRY_SIZE(esize);
+            }
+            debugLvl(2, "%s: batch 0x%zx[0x%zx]", device->name, entry->offset, size);
+            toscaRegDevDoWrite(device, entry->offset, entry->dlen, nelem, batch->staging, NULL,
+                0, NULL, "batch");
+            if (batch->readback)
+                toscaRegDevBatchReadback(device, entry->offset + size - entry->dlen, entry->dlen);
+        }
+        batch->transfers++;
+        pos = next;
+    }
+    batch->used = 0;
+}
+
+static void toscaRegDevBatchFlush(regDevice *device)
+{
+    epicsMutexMustLock(device->batch->lock);
+    toscaRegDevBatchFlushLocked(device);
+    epicsMutexUnlock(device->batch->lock);
+}
+
+/* Returns 0 if write is batched */
+static int toscaRegDevBatchWrite(regDevice *device, size_t offset, unsigned int dlen, size_t nelem,
+    void* pdata, void* pmask)
+{
+    struct toscaRegDevBatch* batch = device->batch;
+    struct toscaRegDevBatchEntry* entry;
+    size_t size = nelem * dlen;
+
+    epicsMutexMustLock(batch->lock);
+    if (size > batch->threshold || dlen > 8)
+    {
+        /* too large: flush to keep the order and write directly */
+        toscaRegDevBatchFlushLocked(device);
+        epicsMutexUnlock(batch->lock);
+        return -1;
+    }
+    entry = (struct toscaRegDevBatchEntry*)(batch->log + batch->used);
+    entry->offset = offset;
+    entry->dlen = dlen;
+    entry->nelem = nelem;
+    entry->masked = pmask != NULL;
+    if (pmask) memcpy(&entry->mask, pmask, dlen);
+    memcpy(entry + 1, pdata, size);
+    batch->used += TOSCA_REGDEV_BATCH_ENTRY_SIZE(size);
+    batch->writes++;
+    if (batch->used >= batch->threshold)
+        toscaRegDevBatchFlushLocked(device);
+    epicsMutexUnlock(batch->lock);
+    epicsEventSignal(batch->wakeup);
+    return 0;
+}
+
+static void toscaRegDevBatchThread(regDevice *device)
+{
+    struct toscaRegDevBatch* batch = device->batch;
+    uint64_t first, age, wait;
+    uint64_t delay = batch->delay * 1000000ULL, maxAge = batch->maxAge * 1000000ULL;
+
+    while (1)
+    {
+        epicsEventMustWait(batch->wakeup);
+        first = toscaRegDevNow();
+        /* flush when writes have stopped for delay ms, at latest after maxAge ms */
+        while ((age = toscaRegDevNow() - first) < maxAge)
+        {
+            wait = maxAge - age < delay ? maxAge - age : delay;
+            if (epicsEventWaitWithTimeout(batch->wakeup, wait * 1e-9) != epicsEventWaitOK) break;
+        }
+        toscaRegDevBatchFlush(device);
+    }
+}
+
+static int toscaRegDevBatchInit(regDevice *device, size_t threshold, unsigned int delay,
+    unsigned int maxAge, int readback)
+{
+    struct toscaRegDevBatch* batch;
+    size_t capacity = 2 * threshold + TOSCA_REGDEV_BATCH_ENTRY_SIZE(0) + 8;
+    char name[32];
+
+    if (!(batch = calloc(1, sizeof(struct toscaRegDevBatch))))
+        return -1;
+    if (!(batch->log = malloc(capacity)) || !(batch->staging = toscaDmaAlloc(capacity)))
+        return -1;
+    batch->lock = epicsMutexMustCreate();
+    batch->wakeup = epicsEventMustCreate(epicsEventEmpty);
+    batch->threshold = threshold;
+    batch->delay = delay;
+    batch->maxAge = maxAge;
+    batch->readback = readback;
+    device->batch = batch;
+    sprintf(name, "batch-%.24s", device->name);
+    if (!epicsThreadCreate(name, epicsThreadPriorityHigh,
+        epicsThreadGetStackSize(epicsThreadStackSmall),
+        (EPICSTHREADFUNC)toscaRegDevBatchThread, device))
+    {
+        device->batch = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int toscaRegDevFlush(const char* name)
+{
+    regDevice* device = regDevFind(name);
+
+    if (!device || device->magic != TOSCA_MAGIC)
+    {
+        error("%s is not a Tosca regDev device", name);
+        errno = EINVAL;
+        return -1;
+    }
+    if (device->batch) toscaRegDevBatchFlush(device);
+    return 0;
+}
+
+int toscaRegDevWrite(
+    regDevice *device,
+    size_t offset,
+    unsigned int dlen,
+    size_t nelem,
+    void* pdata,
+    void* pmask,
+    int priority,
+    regDevTransferComplete callback,
+    const char* user)
+{
+    if (device && device->magic == TOSCA_MAGIC && device->batch && nelem && dlen &&
+        toscaRegDevBatchWrite(device, offset, dlen, nelem, pdata, pmask) == 0)
+        return SUCCESS;
+    return toscaRegDevDoWrite(device, offset, dlen, nelem, pdata, pmask, priority, callback, user);
+}
+
+static void toscaRegDevPioWorker(void* dummy __attribute__((unused)))
+{
+    struct toscaRegDevPioJob job;
+    int status;
+
+    while (epicsMessageQueueReceive(toscaRegDevPioQueue, &job, sizeof(job)) >= 0)
+    {
+        /* without callback the transfer is done synchronously */
+        if (job.write)
+            status = toscaRegDevDoWrite(job.device, job.offset, job.dlen, job.nelem, job.pdata, job.pmask,
+                job.priority, NULL, job.user);
+        else
+            status = toscaRegDevRead(job.device, job.offset, job.dlen, job.nelem, job.pdata,
+                job.priority, NULL, job.user);
+        job.callback(job.user, status);
+    }
+}
+
+static int toscaRegDevPioStart(void)
+{
+    int i;
+    char name[20];
+
+    if (toscaRegDevPioQueue) return 0;
+    if (!(toscaRegDevPioQueue = epicsMessageQueueCreate(256, sizeof(struct toscaRegDevPioJob))))
+        return -1;
+    for (i = 0; i < toscaRegDevPioWorkers; i++)
+    {
+        sprintf(name, "pio%d-TOSCA", i);
+        if (!epicsThreadCreate(name, epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            toscaRegDevPioWorker, NULL))
+        {
+            error("cannot start PIO worker thread %s", name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
 /* Instead of relaying the record processing to a
    callback thread do it directly in the interrupt
    handler thread to save one thread context switch.
@@ -231,6 +1128,55 @@ typedef struct ioscan_head {
 } ioscan_head;
 #endif
 
+void toscaScanIoRequest(IOSCANPVT piosh);
+
+/* Interrupt handler for regDev devices */
+static void toscaRegDevScanIoRequest(regDevice *device, int inum, int ivec)
+{
+    int index = device->addrspace & (VME_A16|VME_A24|VME_A32|VME_A64) ? ivec : inum;
+
+    __sync_fetch_and_add(&device->stats.interrupts, 1);
+    if (device->cache && index == device->cache->index)
+        toscaRegDevCacheInvalidate(device, 0, (size_t)-1);
+    toscaScanIoRequest(device->ioscanpvt[index]);
+}
+
+/* Interrupt handler for ping-pong devices:
+   DMA into the inactive buffer, swap buffers, then scan the I/O Intr records.
+   The records read in callback threads, possibly still from the inactive
+   buffer when the next interrupt arrives. Such an interrupt is skipped and
+   counted as overrun.
+*/
+static void toscaRegDevPingPongHandler(regDevice *device, int inum __attribute__((unused)), int ivec __attribute__((unused)))
+{
+    struct toscaRegDevPingPong* pingpong = device->pingpong;
+    int next = !pingpong->active;
+    uint64_t t0 = toscaRegDevNow();
+
+    __sync_fetch_and_add(&device->stats.interrupts, 1);
+    __sync_synchronize();
+    if (pingpong->readers[next])
+    {
+        debug("%s: ping-pong buffer %d still in use, skip interrupt", device->name, next);
+        pingpong->overruns++;
+        return;
+    }
+    if ((pingpong->status = toscaDmaExecute(pingpong->request[next])) != 0)
+    {
+        errno = pingpong->status;
+        debugErrno("%s: ping-pong DMA", device->name);
+        pingpong->errors++;
+    }
+    else
+    {
+        __sync_synchronize();
+        pingpong->active = next;
+        pingpong->swaps++;
+    }
+    toscaRegDevCount(&device->stats.dmaRead, pingpong->size, pingpong->status, t0);
+    toscaScanIoRequest(device->ioscanpvt[pingpong->index]);
+}
+
 void toscaScanIoRequest(IOSCANPVT piosh)
 {
     int prio;
@@ -299,9 +1245,12 @@ static IOSCANPVT toscaRegDevGetIoScanPvt(
         debug("%s: init %s interrupt %d handling", user, toscaAddrSpaceToStr(device->addrspace), ivec);
         scanIoInit(&device->ioscanpvt[ivec]);
 
-        if (toscaIntrConnectHandler(
+        if (toscaIntrConnectHandlerEx(
             device->addrspace & (VME_A16|VME_A24|VME_A32|VME_A64) ? TOSCA_VME_INTR_ANY_VEC(ivec) : TOSCA_USER1_INTR(ivec),
-            toscaScanIoRequest, device->ioscanpvt[ivec]) != 0)
+            device->pingpong && ivec == device->pingpong->index ?
+                (void(*)())toscaRegDevPingPongHandler : (void(*)())toscaRegDevScanIoRequest,
+            device,
+            &(toscaIntrOptions_t) { .maxRate = device->intrRate }) != 0)
         {
             unsigned int intraddrspace = device->addrspace;
             if (intraddrspace & (TOSCA_USER1|TOSCA_USER2|TOSCA_SMEM))
@@ -327,10 +1276,91 @@ static IOSCANPVT toscaRegDevGetIoScanPvt(
     return device->ioscanpvt[ivec];
 }
 
+static void toscaRegDevPingPongFree(struct toscaRegDevPingPong* pingpong)
+{
+    int i;
+
+    int e = errno;
+
+    for (i = 0; i < 2; i++)
+    {
+        toscaDmaRelease(pingpong->request[i]);
+        toscaDmaFree(pingpong->buffer[i]);
+    }
+    free(pingpong);
+    errno = e;
+}
+
+static int toscaRegDevPingPongInit(regDevice *device, size_t size)
+{
+    struct toscaRegDevPingPong* pingpong;
+    int i;
+
+    if (!device->dmaSpace)
+    {
+        error("%s: ping-pong mode needs DMA", device->name);
+        errno = EINVAL;
+        return -1;
+    }
+    if (device->ivec < 0)
+    {
+        error("%s: ping-pong mode needs intr=", device->name);
+        errno = EINVAL;
+        return -1;
+    }
+    if (size & 7)
+    {
+        /* DMA cannot transfer a partial 8 byte word and must not read beyond the device */
+        error("%s: ping-pong mode needs a size multiple of 8", device->name);
+        errno = EINVAL;
+        return -1;
+    }
+    if (!(pingpong = calloc(1, sizeof(struct toscaRegDevPingPong)))) return -1;
+    for (i = 0; i < 2; i++)
+    {
+        if (!(pingpong->buffer[i] = toscaDmaAlloc(size)) ||
+            !(pingpong->request[i] = toscaDmaSetup(device->dmaSpace, device->baseaddr, 0,
+            (uint64_t)(size_t)pingpong->buffer[i], size, device->swap, device->dmaTimeout, NULL, NULL)))
+        {
+            toscaRegDevPingPongFree(pingpong);
+            return -1;
+        }
+    }
+    /* initial snapshot */
+    if ((pingpong->status = toscaDmaExecute(pingpong->request[0])) != 0)
+    {
+        errno = pingpong->status;
+        error("%s: initial ping-pong DMA failed: %m", device->name);
+    }
+    pingpong->size = size;
+    pingpong->index = device->ivec;
+    if (device->addrspace & TOSCA_USER2)
+        pingpong->index ^= 16;
+    device->pingpong = pingpong;
+    if (!toscaRegDevGetIoScanPvt(device, 0, 0, 0, device->ivec, device->name))
+    {
+        device->pingpong = NULL;
+        toscaRegDevPingPongFree(pingpong);
+        return -1;
+    }
+    return 0;
+}
+
+/* Array records (waveform, aai, aao) get their buffers from here.
+   DMA transfers then go directly to or from the record buffer and the
+   DMA engine does the byte swapping.
+*/
 void* toscaRegDevDmaAlloc(regDevice *device __attribute__((unused)), void* ptr, size_t size)
 {
-    if (ptr) free(ptr);
-    if (size) return valloc(size); /* in principle we can use any memory, but page aligned is more efficient */
+    /* the buffer may come from elsewhere, e.g. from regDev itself */
+    if (ptr)
+    {
+        if (toscaDmaIsPoolBuffer(ptr))
+            toscaDmaFree(ptr);
+        else
+            free(ptr);
+    }
+    if (size) return toscaDmaAlloc(size);
     return NULL;
 }
 
@@ -346,6 +1376,12 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
 {
     regDevice* device;
     int blockmode = 0;
+    int pingpong = 0;
+    unsigned int cacheAge = 0;
+    size_t batch = 0;
+    unsigned int batchDelay = 10;
+    unsigned int batchAge = 100;
+    int readback = 0;
 
     debug("toscaRegDevConfigure(name=%s, addrspace=0x%x(%s), address=0x%zx size=0x%zx, flags=\"%s\")",
         name, addrspace, toscaAddrSpaceToStr(addrspace), address, size, flags);
@@ -364,14 +1400,17 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
     device->magic = TOSCA_MAGIC;
     device->name = strdup(name);
     device->baseaddr = address;
+    device->size = size;
     device->dmaReadLimit = 100;
     device->dmaWriteLimit = 2048;
     device->ivec = -1;
+    device->recordsLock = epicsMutexMustCreate();
 
     device->addrspace = addrspace;
     if (addrspace & (TOSCA_USER1|TOSCA_USER2|TOSCA_CSR|TOSCA_IO)) device->swap = 4;
     if (addrspace & (TOSCA_USER1|TOSCA_USER2|TOSCA_SMEM)) device->dmaSpace = addrspace;
     if (addrspace & VME_A32) device->dmaSpace  = VME_SCT;
+    if (addrspace & (TOSCA_USER1|TOSCA_USER2|TOSCA_SMEM)) device->wideRead = 1; /* VME slaves may only support D16/D32 */
 
     if (flags)
     {
@@ -405,6 +1444,7 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
             if (strncasecmp(p, "block", l) == 0)      { blockmode |= REGDEV_BLOCK_READ|REGDEV_BLOCK_WRITE; continue; }
             if (strncasecmp(p, "blockread", l) == 0)  { blockmode |= REGDEV_BLOCK_READ; continue; }
             if (strncasecmp(p, "blockwrite", l) == 0) { blockmode |= REGDEV_BLOCK_WRITE; continue; }
+            if (strncasecmp(p, "pingpong", l) == 0)   { pingpong = 1; continue; }
 
             debug("blockmode = %s%s", blockmode & 1 ? "read " : "", blockmode & 2 ? "write" : "");
 
@@ -412,6 +1452,10 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
             if (strncasecmp(p, "dmaonly", l) == 0)   { device->dmaReadLimit = device->dmaWriteLimit = 1; continue; }
             if (strncasecmp(p, "dmaReadLimit=", 13) == 0)  { device->dmaReadLimit  = toscaStrToSize(p+13); continue; }
             if (strncasecmp(p, "dmaWriteLimit=", 14) == 0) { device->dmaWriteLimit = toscaStrToSize(p+14); continue; }
+            if (strncasecmp(p, "dmaTimeout=", 11) == 0)    { device->dmaTimeout = strtol(p+11, NULL, 0); continue; }
+
+            if (strncasecmp(p, "wideread", l) == 0)   { device->wideRead = 1; continue; }
+            if (strncasecmp(p, "nowideread", l) == 0) { device->wideRead = 0; continue; }
 
             if (strncasecmp(p, "SCT", l) == 0)       { device->dmaSpace = VME_SCT; continue; }
             if (strncasecmp(p, "BLT", l) == 0)       { device->dmaSpace = VME_BLT; continue; }
@@ -424,6 +1468,29 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
             if (strncasecmp(p, "2eSST", l) == 0)     { device->dmaSpace = VME_2eSST320; continue; }
 
             if (strncasecmp(p, "intr=", 5) == 0) { device->ivec = strtol(p+5, NULL, 0); continue; } /* Better use V= in record */
+            if (strncasecmp(p, "intrRate=", 9) == 0) { device->intrRate = strtoul(p+9, NULL, 0); continue; }
+            if (strncasecmp(p, "merge=", 6) == 0) { device->mergeWindow = strtoul(p+6, NULL, 0); continue; }
+            if (strncasecmp(p, "cache=", 6) == 0)
+            {
+                char* e;
+                size_t start = strtoul(p+6, &e, 0);
+                if (toscaRegDevCacheAddRange(device, start, *e == ':' ? toscaStrToSize(e+1) : 4) != 0)
+                    error("%s: cannot add cache range %.*s", name, (int)l, p);
+                continue;
+            }
+            if (strncasecmp(p, "cache", l) == 0)
+            {
+                if (toscaRegDevCacheAddRange(device, 0, 0) != 0)
+                    error("%s: cannot add cache range", name);
+                continue;
+            }
+            if (strncasecmp(p, "cacheAge=", 9) == 0) { cacheAge = strtoul(p+9, NULL, 0); continue; }
+            if (strncasecmp(p, "batch=", 6) == 0) { batch = toscaStrToSize(p+6); continue; }
+            if (strncasecmp(p, "batch", l) == 0) { batch = 0x10000; continue; }
+            if (strncasecmp(p, "batchDelay=", 11) == 0) { batchDelay = strtoul(p+11, NULL, 0); continue; }
+            if (strncasecmp(p, "batchAge=", 9) == 0) { batchAge = strtoul(p+9, NULL, 0); continue; }
+            if (strncasecmp(p, "readback", l) == 0) { readback = 1; continue; }
+            if (strncasecmp(p, "pioAsync=", 9) == 0) { device->pioAsyncLimit = toscaStrToSize(p+9); continue; }
         }
     }
     if (device->dmaSpace & VME_BLOCKTRANSFER && !(addrspace & VME_A32))
@@ -473,6 +1540,53 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
         return -1;
     }
 
+    if (pingpong)
+    {
+        if (toscaRegDevPingPongInit(device, size) != 0)
+        {
+            error("%s: cannot set up ping-pong mode: %m", name);
+        }
+        else
+            blockmode &= ~REGDEV_BLOCK_READ; /* reads come from the ping-pong buffers */
+    }
+    else if (device->mergeWindow && toscaRegDevMergeInit(device) != 0)
+        error("%s: cannot start read merging: %m", name);
+
+    if (device->cache && pingpong)
+    {
+        /* reads come from the ping-pong buffers anyway */
+        error("%s: cache and pingpong cannot be combined, ignoring cache", name);
+        free(device->cache);
+        device->cache = NULL;
+    }
+    else if (device->cache)
+    {
+        device->cache->maxAge = cacheAge;
+        if (toscaRegDevCacheInit(device, size) != 0)
+        {
+            error("%s: cannot set up cache: %m", name);
+            if (device->cache->lock) epicsMutexDestroy(device->cache->lock);
+            free(device->cache);
+            device->cache = NULL;
+        }
+        else if (device->ivec >= 0)
+        {
+            /* invalidate on default interrupt */
+            device->cache->index = device->addrspace & TOSCA_USER2 ? device->ivec ^ 16 : device->ivec;
+            if (!toscaRegDevGetIoScanPvt(device, 0, 0, 0, device->ivec, name))
+                device->cache->index = -1;
+        }
+    }
+
+    if (batch && toscaRegDevBatchInit(device, batch, batchDelay, batchAge, readback) != 0)
+        error("%s: cannot start write batching: %m", name);
+
+    if (device->pioAsyncLimit && toscaRegDevPioStart() != 0)
+    {
+        error("%s: cannot start PIO workers, using synchronous PIO: %m", name);
+        device->pioAsyncLimit = 0;
+    }
+
     regDevRegisterDmaAlloc(device, toscaRegDevDmaAlloc);
     if (blockmode) regDevMakeBlockdevice(device, blockmode, REGDEV_NO_SWAP, NULL);
 
@@ -508,12 +1622,23 @@ static void toscaRegDevConfigureFunc(const iocshArgBuf *args)
                "           (Minimum number of array elements to use DMA)\n"
                "           nodma (same as 0 for both limits)\n"
                "           dmaonly (same as 1 both both limits)\n"
+               "           dmaTimeout= (ms, also info(toscaDmaTimeout) in record)\n"
                "   - block mode: blockread, blockwrite, block (means both)\n"
                "           (Records with PRIO=HIGH trigger transfer)\n"
+               "   - ping-pong block read: pingpong (DMA on intr= into alternating buffers)\n"
+               "   - PIO array reads with 64 bit loads: wideread, nowideread\n"
+               "           (Default for USER* and SMEM is wideread)\n"
                "   - VME block transfer: SCT, BLT, MBLT, 2eVME, 2eSST[160|267|320]\n"
                "   - VME default interrupt vector: intr=1...255\n"
                "   - USER[1|2] default interrupt line: intr=0...15\n"
                "           (Better use V=... in record link)\n"
+               "   - interrupt moderation: intrRate= (max scans per second)\n"
+               "   - read merging: merge= (collect reads for so many microseconds)\n"
+               "   - read cache: cache (whole device) or cache=offset[:size] (repeatable)\n"
+               "           cacheAge= (max age in ms), invalidated by writes and intr=\n"
+               "   - write batching: batch (64k) or batch= (bytes), batchDelay= (ms, default 10),\n"
+               "     batchAge= (ms, default 100), readback (read back batched writes)\n"
+               "   - async PIO: pioAsync= (minimum bytes for memory map transfers in worker threads)\n"
         );
         return;
     }
@@ -540,9 +1665,90 @@ static void toscaRegDevConfigureFunc(const iocshArgBuf *args)
     }
 }
 
+/* Read-only statistics device, see struct toscaRegDevStats for the layout */
+
+void toscaRegDevStatsReport(regDevice *device, int level)
+{
+    printf("Tosca statistics of %s\n", device->name);
+    if (level > 0) toscaRegDevReport(device, level);
+}
+
+int toscaRegDevStatsRead(
+    regDevice *device,
+    size_t offset,
+    unsigned int dlen,
+    size_t nelem,
+    void* pdata,
+    int priority __attribute__((unused)),
+    regDevTransferComplete callback __attribute__((unused)),
+    const char* user __attribute__((unused)))
+{
+    regDevCopy(dlen, nelem, (char*)&device->stats + offset, pdata, NULL, REGDEV_NO_SWAP);
+    return SUCCESS;
+}
+
+struct regDevSupport toscaRegDevStats = {
+    .report = toscaRegDevStatsReport,
+    .read = toscaRegDevStatsRead,
+};
+
+int toscaRegDevStatsConfigure(const char* name, const char* devname)
+{
+    regDevice* device;
+
+    if (!name || !devname)
+    {
+        error("usage: toscaRegDevStatsConfigure name device");
+        return -1;
+    }
+    device = regDevFind(devname);
+    if (!device || device->magic != TOSCA_MAGIC)
+    {
+        error("%s is not a Tosca regDev device", devname);
+        return -1;
+    }
+    if (regDevFind(name))
+    {
+        error("name \"%s\" already in use", name);
+        return -1;
+    }
+    if (regDevRegisterDevice(name, &toscaRegDevStats, device, sizeof(struct toscaRegDevStats)) != SUCCESS)
+    {
+        error("regDevRegisterDevice() failed");
+        return -1;
+    }
+    return 0;
+}
+
+static const iocshFuncDef toscaRegDevStatsConfigureDef =
+    { "toscaRegDevStatsConfigure", 2, (const iocshArg *[]) {
+    &(iocshArg) { "name", iocshArgString },
+    &(iocshArg) { "device", iocshArgString },
+}};
+
+static void toscaRegDevStatsConfigureFunc(const iocshArgBuf *args)
+{
+    if (toscaRegDevStatsConfigure(args[0].sval, args[1].sval) != 0)
+    {
+        if (!interruptAccept) epicsExit(-1);
+    }
+}
+
+static const iocshFuncDef toscaRegDevFlushDef =
+    { "toscaRegDevFlush", 1, (const iocshArg *[]) {
+    &(iocshArg) { "device", iocshArgString },
+}};
+
+static void toscaRegDevFlushFunc(const iocshArgBuf *args)
+{
+    toscaRegDevFlush(args[0].sval);
+}
+
 static void toscaRegDevRegistrar(void)
 {
+    iocshRegister(&toscaRegDevFlushDef, toscaRegDevFlushFunc);
     iocshRegister(&toscaRegDevConfigureDef, toscaRegDevConfigureFunc);
+    iocshRegister(&toscaRegDevStatsConfigureDef, toscaRegDevStatsConfigureFunc);
     toscaRegDevDebug = 0;
 }
 
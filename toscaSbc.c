@@ -14,13 +14,16 @@
 
 struct regDevice
 {
-    int fmc;
+    unsigned int fmc;
     unsigned int base;
 };
 
 void toscaSbcDevReport(regDevice *device, int level __attribute__((unused)))
 {
-    printf("Tosca Serial Bus to FMC %d 0x%x\n", device->fmc, device->base);
+    if (device->fmc >> 16)
+        printf("Tosca %u Serial Bus to FMC %d 0x%x\n", (device->fmc >> 16) - 1, device->fmc & 0xffff, device->base);
+    else
+        printf("Tosca Serial Bus to FMC %d 0x%x\n", device->fmc, device->base);
 }
 
 int toscaSbcDevRead(
@@ -33,26 +36,26 @@ int toscaSbcDevRead(
     regDevTransferComplete callback __attribute__((unused)),
     const char* user)
 {
-    size_t i;
-    epicsUInt32 value;
+    size_t i, j, n;
+    unsigned int values[64];
     
-    debugLvl(2, "%s %s(FMC%d):0x%zx dlen=%d nelm=%zd", user, regDevName(device), device->fmc, offset, dlen, nelem);
+    debugLvl(2, "%s %s(FMC0x%x):0x%zx dlen=%d nelm=%zd", user, regDevName(device), device->fmc, offset, dlen, nelem);
     if (dlen == 0) return 0; /* any way to check online status ? */
+    if (dlen != 1 && dlen != 2 && dlen != 4) return -1;
     offset += device->base;
-    for (i = 0; i < nelem; i++)
+    for (i = 0; i < nelem; i += n)
     {
-        value = toscaSbcRead(device->fmc, offset+i);
-        if (errno)
+        n = nelem - i < 64 ? nelem - i : 64;
+        if (toscaSbcReadBlock(device->fmc, offset+i, n, values) != 0)
         {
-            debugErrno("toscaSbcRead(%d,0x%zx)", device->fmc, offset+i);
+            debugErrno("toscaSbcReadBlock(0x%x,0x%zx,%zu)", device->fmc, offset+i, n);
             return errno;
         }
-        switch (dlen)
+        for (j = 0; j < n; j++) switch (dlen)
         {
-            case 1: ((epicsUInt8*)pdata)[i] = (epicsUInt8)value; break;
-            case 2: ((epicsUInt16*)pdata)[i] = (epicsUInt16)value; break;
-            case 4: ((epicsUInt32*)pdata)[i] = (epicsUInt32)value; break;
-            default: return -1;
+            case 1: ((epicsUInt8*)pdata)[i+j] = (epicsUInt8)values[j]; break;
+            case 2: ((epicsUInt16*)pdata)[i+j] = (epicsUInt16)values[j]; break;
+            case 4: ((epicsUInt32*)pdata)[i+j] = (epicsUInt32)values[j]; break;
         }
     }
     return 0;
@@ -69,8 +72,8 @@ int toscaSbcDevWrite(
     regDevTransferComplete callback __attribute__((unused)),
     const char* user)
 {
-    size_t i;
-    epicsUInt32 value;
+    size_t i, j, n;
+    unsigned int values[64];
     epicsUInt32 mask = 0xffffffff;
     
     if (pmask)
@@ -83,21 +86,22 @@ int toscaSbcDevWrite(
             default: return -1;
         }
     }
-    debugLvl(2, "%s %s(FMC%d):0x%zx dlen=%d nelm=%zd mask=0x%x", user, regDevName(device), device->fmc, offset, dlen, nelem, mask);
+    debugLvl(2, "%s %s(FMC0x%x):0x%zx dlen=%d nelm=%zd mask=0x%x", user, regDevName(device), device->fmc, offset, dlen, nelem, mask);
+    if (dlen != 1 && dlen != 2 && dlen != 4) return -1;
     offset += device->base;
-    for (i = 0; i < nelem; i++)
+    for (i = 0; i < nelem; i += n)
     {
-        switch (dlen)
+        n = nelem - i < 64 ? nelem - i : 64;
+        for (j = 0; j < n; j++) switch (dlen)
         {
-            case 1: value = ((epicsUInt8*)pdata)[i]; break;
-            case 2: value = ((epicsUInt16*)pdata)[i]; break;
-            case 4: value = ((epicsUInt32*)pdata)[i]; break;
-            default: return -1;
+            case 1: values[j] = ((epicsUInt8*)pdata)[i+j]; break;
+            case 2: values[j] = ((epicsUInt16*)pdata)[i+j]; break;
+            case 4: values[j] = ((epicsUInt32*)pdata)[i+j]; break;
         }
-        toscaSbcWriteMasked(device->fmc, offset+i, mask, value);
-        if (errno)
+        /* nobody looks at a read back value here */
+        if (toscaSbcWriteBlock(device->fmc, offset+i, n, mask, values, NULL) != 0)
         {
-            debugErrno("toscaSbcWriteMasked(%d, 0x%zx, 0x%x, 0x%x)", device->fmc, offset+i, mask, value);
+            debugErrno("toscaSbcWriteBlock(0x%x, 0x%zx, %zu, 0x%x)", device->fmc, offset+i, n, mask);
             return errno;
         }
     }
@@ -110,6 +114,18 @@ struct regDevSupport toscaSbcDevRegDev = {
     .write = toscaSbcDevWrite,
 };
 
+/* "[device:]fmc" to fmc_slot */
+static unsigned int toscaSbcStrToSlot(const char* str)
+{
+    char* p;
+    unsigned int fmc;
+
+    if (!str) return 0;
+    fmc = strtoul(str, &p, 0);
+    if (*p == ':') return TOSCA_SBC_SLOT(fmc, strtoul(p+1, NULL, 0));
+    return fmc;
+}
+
 int toscaSbcDevConfigure(const char* name, unsigned int fmc, unsigned int addr, unsigned int size)
 {
     regDevice *device = NULL;
@@ -119,7 +135,7 @@ int toscaSbcDevConfigure(const char* name, unsigned int fmc, unsigned int addr,
         iocshCmd("help toscaSbcDevConfigure");
         return -1;
     }
-    if (fmc < 1 || fmc > 2)
+    if ((fmc & 0xffff) < 1 || (fmc & 0xffff) > 2)
     {
         fprintf(stderr, "fmc_slot must be 1 or 2\n");
         return -1;
@@ -155,25 +171,25 @@ int toscaSbcDevConfigure(const char* name, unsigned int fmc, unsigned int addr,
 static const iocshFuncDef toscaSbcDevConfigureDef =
     { "toscaSbcDevConfigure", 4, (const iocshArg *[]) {
     &(iocshArg) { "name", iocshArgString },
-    &(iocshArg) { "fmc_slot(1|2)", iocshArgInt },
+    &(iocshArg) { "[device:]fmc_slot(1|2)", iocshArgString },
     &(iocshArg) { "addr", iocshArgInt },
     &(iocshArg) { "size", iocshArgInt },
 }};
 
 static void toscaSbcDevConfigureFunc(const iocshArgBuf *args)
 {
-    toscaSbcDevConfigure(args[0].sval, args[1].ival, args[2].ival, args[3].ival);
+    toscaSbcDevConfigure(args[0].sval, toscaSbcStrToSlot(args[1].sval), args[2].ival, args[3].ival);
 }
 
 static const iocshFuncDef toscaSbcReadDef =
     { "toscaSbcRead", 2, (const iocshArg *[]) {
-    &(iocshArg) { "fmc_slot(1|2)", iocshArgInt },
+    &(iocshArg) { "[device:]fmc_slot(1|2)", iocshArgString },
     &(iocshArg) { "register", iocshArgInt },
 }};
 
 static void toscaSbcReadFunc(const iocshArgBuf *args)
 {
-    unsigned int fmc = args[0].ival;
+    unsigned int fmc = toscaSbcStrToSlot(args[0].sval);
     unsigned int reg = args[1].ival;
     unsigned int val;
     val = toscaSbcRead(fmc, reg);
@@ -185,14 +201,14 @@ static void toscaSbcReadFunc(const iocshArgBuf *args)
 
 static const iocshFuncDef toscaSbcWriteDef =
     { "toscaSbcWrite", 3, (const iocshArg *[]) {
-    &(iocshArg) { "fmc_slot(1|2)", iocshArgInt },
+    &(iocshArg) { "[device:]fmc_slot(1|2)", iocshArgString },
     &(iocshArg) { "register_address", iocshArgInt },
     &(iocshArg) { "value", iocshArgInt },
 }};
 
 static void toscaSbcWriteFunc(const iocshArgBuf *args)
 {
-    unsigned int fmc = args[0].ival;
+    unsigned int fmc = toscaSbcStrToSlot(args[0].sval);
     unsigned int reg = args[1].ival;
     unsigned int val = args[2].ival;
     toscaSbcWrite(fmc, reg, val);
@@ -202,7 +218,7 @@ static void toscaSbcWriteFunc(const iocshArgBuf *args)
 
 static const iocshFuncDef toscaSbcWriteMaskedDef =
     { "toscaSbcWriteMasked", 4, (const iocshArg *[]) {
-    &(iocshArg) { "fmc_slot(1|2)", iocshArgInt },
+    &(iocshArg) { "[device:]fmc_slot(1|2)", iocshArgString },
     &(iocshArg) { "register_address", iocshArgInt },
     &(iocshArg) { "mask", iocshArgInt },
     &(iocshArg) { "value", iocshArgInt },
@@ -210,7 +226,7 @@ static const iocshFuncDef toscaSbcWriteMaskedDef =
 
 static void toscaSbcWriteMaskedFunc(const iocshArgBuf *args)
 {
-    unsigned int fmc = args[0].ival;
+    unsigned int fmc = toscaSbcStrToSlot(args[0].sval);
     unsigned int reg = args[1].ival;
     unsigned int mask= args[2].ival;
     unsigned int val = args[3].ival;
@@ -223,14 +239,14 @@ static void toscaSbcWriteMaskedFunc(const iocshArgBuf *args)
 
 static const iocshFuncDef toscaSbcSetDef =
     { "toscaSbcSet", 3, (const iocshArg *[]) {
-    &(iocshArg) { "fmc_slot(1|2)", iocshArgInt },
+    &(iocshArg) { "[device:]fmc_slot(1|2)", iocshArgString },
     &(iocshArg) { "register_address", iocshArgInt },
     &(iocshArg) { "bitsToSet", iocshArgInt },
 }};
 
 static void toscaSbcSetFunc(const iocshArgBuf *args)
 {
-    unsigned int fmc = args[0].ival;
+    unsigned int fmc = toscaSbcStrToSlot(args[0].sval);
     unsigned int reg = args[1].ival;
     unsigned int val = args[2].ival;
     val = toscaSbcSet(fmc, reg, val);
@@ -242,14 +258,14 @@ static void toscaSbcSetFunc(const iocshArgBuf *args)
 
 static const iocshFuncDef toscaSbcClearDef =
     { "toscaSbcClear", 3, (const iocshArg *[]) {
-    &(iocshArg) { "fmc_slot(1|2)", iocshArgInt },
+    &(iocshArg) { "[device:]fmc_slot(1|2)", iocshArgString },
     &(iocshArg) { "register_address", iocshArgInt },
     &(iocshArg) { "bitsToClear", iocshArgInt },
 }};
 
 static void toscaSbcClearFunc(const iocshArgBuf *args)
 {
-    unsigned int fmc = args[0].ival;
+    unsigned int fmc = toscaSbcStrToSlot(args[0].sval);
     unsigned int reg = args[1].ival;
     unsigned int val = args[2].ival;
     val = toscaSbcClear(fmc, reg, val);
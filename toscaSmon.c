@@ -3,6 +3,10 @@
 #include <string.h>
 
 #include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <dbScan.h>
 #include <iocsh.h>
 #include <epicsStdioRedirect.h>
 #include <regDev.h>
@@ -139,8 +143,267 @@ static void smonShow(unsigned int addr, unsigned int val)
         fprintf(stderr, "%m\n");
         return;
     }
-    printf("%-11s ", smonAddrToStr(addr));
-    smonFormat(addr, val);
+    printf("%-11s ", smonAddrToStr(addr & 0xffff));
+    smonFormat(addr & 0xffff, val);
+    printf("\n");
+}
+
+/* Sampler:
+   A thread reads a set of registers periodically with one lock hold
+   into one of two snapshot buffers and then makes it the active one.
+   Readers copy from the active buffer and retry if the sampler has
+   started writing it again meanwhile (odd seq).
+*/
+
+#define SMON_REGS 0x80
+
+struct toscaSmonSnapshot
+{
+    epicsTimeStamp time;
+    unsigned long sweeps;
+    epicsUInt16 value[SMON_REGS];
+    epicsUInt16 min[SMON_REGS];
+    epicsUInt16 max[SMON_REGS];
+    double sum[SMON_REGS];
+    unsigned long n[SMON_REGS];
+};
+
+struct toscaSmonSampler
+{
+    struct toscaSmonSampler* next;
+    unsigned int device;
+    double period;
+    unsigned int count;
+    unsigned int addr[SMON_REGS];
+    char sampled[SMON_REGS];
+    volatile char reset[SMON_REGS];
+    struct toscaSmonSnapshot snapshot[2];
+    volatile unsigned int seq[2];
+    volatile unsigned int active;
+    unsigned long errors;
+    IOSCANPVT ioscanpvt;
+};
+
+static struct toscaSmonSampler* toscaSmonSamplers;
+static epicsMutexId toscaSmonSamplersLock;
+
+static struct toscaSmonSampler* toscaSmonSamplerFind(unsigned int device)
+{
+    struct toscaSmonSampler* sampler;
+    for (sampler = toscaSmonSamplers; sampler; sampler = sampler->next)
+        if (sampler->device == device) break;
+    return sampler;
+}
+
+static int toscaSmonSamplerSweep(struct toscaSmonSampler* sampler)
+{
+    unsigned int values[SMON_REGS];
+    unsigned int i, next = !sampler->active;
+    struct toscaSmonSnapshot* s = &sampler->snapshot[next];
+
+    if (toscaSmonReadList(sampler->device, sampler->count, sampler->addr, values) != 0)
+    {
+        sampler->errors++;
+        return -1;
+    }
+    sampler->seq[next]++;
+    __sync_synchronize();
+    *s = sampler->snapshot[sampler->active];
+    epicsTimeGetCurrent(&s->time);
+    s->sweeps++;
+    for (i = 0; i < sampler->count; i++)
+    {
+        unsigned int a = sampler->addr[i];
+        epicsUInt16 v = values[i];
+        if (sampler->reset[a] || !s->n[a])
+        {
+            sampler->reset[a] = 0;
+            s->n[a] = 0;
+            s->sum[a] = 0;
+            s->min[a] = v;
+            s->max[a] = v;
+        }
+        s->value[a] = v;
+        if (v < s->min[a]) s->min[a] = v;
+        if (v > s->max[a]) s->max[a] = v;
+        s->sum[a] += v;
+        s->n[a]++;
+    }
+    __sync_synchronize();
+    sampler->seq[next]++;
+    sampler->active = next;
+    return 0;
+}
+
+static void toscaSmonSamplerThread(struct toscaSmonSampler* sampler)
+{
+    while (1)
+    {
+        epicsThreadSleep(sampler->period);
+        if (toscaSmonSamplerSweep(sampler) == 0)
+            scanIoRequest(sampler->ioscanpvt);
+    }
+}
+
+/* Copies nelem values starting at address from the active snapshot:
+   0x000-0x07f: last value, 0x080-0x0ff: min, 0x100-0x17f: max, 0x180-0x1ff: average.
+   Returns 0, or -1 if any address is not sampled.
+*/
+static int toscaSmonSamplerGet(struct toscaSmonSampler* sampler, unsigned int address, size_t nelem,
+    epicsUInt16* values, epicsTimeStamp* time)
+{
+    unsigned int i, s, seq;
+    const struct toscaSmonSnapshot* snapshot;
+
+    for (i = 0; i < nelem; i++)
+        if (address + i >= 4*SMON_REGS || !sampler->sampled[(address + i) & (SMON_REGS-1)]) return -1;
+    do {
+        s = sampler->active;
+        seq = sampler->seq[s];
+        __sync_synchronize();
+        snapshot = &sampler->snapshot[s];
+        for (i = 0; i < nelem; i++)
+        {
+            unsigned int a = (address + i) & (SMON_REGS-1);
+            switch ((address + i) / SMON_REGS)
+            {
+                case 0: values[i] = snapshot->value[a]; break;
+                case 1: values[i] = snapshot->min[a]; break;
+                case 2: values[i] = snapshot->max[a]; break;
+                case 3: values[i] = snapshot->n[a] ? snapshot->sum[a] / snapshot->n[a] + 0.5 : 0; break;
+            }
+        }
+        if (time) *time = snapshot->time;
+        __sync_synchronize();
+    } while ((seq & 1) || sampler->seq[s] != seq);
+    return 0;
+}
+
+static int toscaSmonStrToChannels(const char* str, char* sampled)
+{
+    char* p;
+    unsigned long first, last;
+
+    if (!str || !*str) str = "0x00-0x05,0x08-0x09,0x10-0x1f,0x20-0x22,0x24-0x26,0x3f";
+    while (*str)
+    {
+        first = last = strtoul(str, &p, 0);
+        if (p == str) return -1;
+        if (*p == '-')
+        {
+            str = p+1;
+            last = strtoul(str, &p, 0);
+            if (p == str) return -1;
+        }
+        if (first > last || last >= SMON_REGS) return -1;
+        while (first <= last) sampled[first++] = 1;
+        if (*p == ',') p++;
+        else if (*p) return -1;
+        str = p;
+    }
+    return 0;
+}
+
+int toscaSmonSamplerStart(unsigned int device, double period, const char* channels)
+{
+    struct toscaSmonSampler* sampler;
+    unsigned int a;
+    char threadname[16];
+
+    debug("device=%u period=%g channels=%s", device, period, channels);
+    if (!toscaSmonSamplersLock)
+        toscaSmonSamplersLock = epicsMutexMustCreate();
+    epicsMutexMustLock(toscaSmonSamplersLock);
+    sampler = toscaSmonSamplerFind(device);
+    epicsMutexUnlock(toscaSmonSamplersLock);
+    if (sampler)
+    {
+        error("sampler for device %u already running", device);
+        errno = EEXIST;
+        return -1;
+    }
+    if (!(sampler = calloc(1, sizeof(struct toscaSmonSampler))))
+    {
+        error("cannot allocate sampler: %m");
+        return -1;
+    }
+    if (toscaSmonStrToChannels(channels, sampler->sampled) != 0)
+    {
+        error("invalid channel list \"%s\", expect e.g. \"0x00-0x05,0x10\"", channels);
+        free(sampler);
+        errno = EINVAL;
+        return -1;
+    }
+    for (a = 0; a < SMON_REGS; a++)
+        if (sampler->sampled[a]) sampler->addr[sampler->count++] = a;
+    sampler->device = device;
+    sampler->period = period > 0 ? period : 1.0;
+    scanIoInit(&sampler->ioscanpvt);
+    /* have a first snapshot before anyone reads */
+    if (toscaSmonSamplerSweep(sampler) != 0)
+    {
+        error("cannot read Smon registers of device %u: %m", device);
+        free(sampler);
+        return -1;
+    }
+    sprintf(threadname, "smon%u", device);
+    if (!epicsThreadCreate(threadname, epicsThreadPriorityLow,
+        epicsThreadGetStackSize(epicsThreadStackSmall),
+        (EPICSTHREADFUNC)toscaSmonSamplerThread, sampler))
+    {
+        error("cannot start sampler thread: %m");
+        free(sampler);
+        return -1;
+    }
+    epicsMutexMustLock(toscaSmonSamplersLock);
+    sampler->next = toscaSmonSamplers;
+    toscaSmonSamplers = sampler;
+    epicsMutexUnlock(toscaSmonSamplersLock);
+    return 0;
+}
+
+static void toscaSmonSamplerReport(struct toscaSmonSampler* sampler)
+{
+    char timestr[40];
+    const struct toscaSmonSnapshot* snapshot = &sampler->snapshot[sampler->active];
+
+    epicsTimeToStrftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S.%03f", &snapshot->time);
+    printf("device %u: %u registers every %gs, %lu sweeps, %lu errors, last %s\n",
+        sampler->device, sampler->count, sampler->period, snapshot->sweeps, sampler->errors, timestr);
+}
+
+/* Value from the sampler if the register is sampled, else from hardware */
+static unsigned int smonGet(unsigned int address)
+{
+    struct toscaSmonSampler* sampler = toscaSmonSamplerFind(address >> 16);
+    epicsUInt16 value;
+
+    if (sampler && (address & 0xffff) < SMON_REGS &&
+        toscaSmonSamplerGet(sampler, address & 0xffff, 1, &value, NULL) == 0)
+    {
+        errno = 0;
+        return value;
+    }
+    return toscaSmonRead(address);
+}
+
+static void smonShowStats(unsigned int address)
+{
+    struct toscaSmonSampler* sampler = toscaSmonSamplerFind(address >> 16);
+    epicsUInt16 min, max, avg;
+    unsigned int a = address & 0xffff;
+
+    if (!sampler || a >= SMON_REGS ||
+        toscaSmonSamplerGet(sampler, a + SMON_REGS, 1, &min, NULL) != 0 ||
+        toscaSmonSamplerGet(sampler, a + 2*SMON_REGS, 1, &max, NULL) != 0 ||
+        toscaSmonSamplerGet(sampler, a + 3*SMON_REGS, 1, &avg, NULL) != 0)
+        return;
+    printf("%-11s ", "  min");
+    smonFormat(a, min);
+    printf("\n%-11s ", "  max");
+    smonFormat(a, max);
+    printf("\n%-11s ", "  avg");
+    smonFormat(a, avg);
     printf("\n");
 }
 
@@ -169,6 +432,11 @@ static void toscaSmonReadFunc(const iocshArgBuf *args)
     if (!addrstr || !*addrstr)
     {
         unsigned int d, devs = toscaNumDevices();
+        struct toscaSmonSampler* sampler;
+
+        for (sampler = toscaSmonSamplers; sampler; sampler = sampler->next)
+            if (dev == -1 || sampler->device == dev)
+                toscaSmonSamplerReport(sampler);
         for (addr = 0; addr < 0x43; addr++)
         {
             if (addr == 0x06) addr = 0x08;
@@ -179,27 +447,29 @@ static void toscaSmonReadFunc(const iocshArgBuf *args)
             printf("%-11s ", smonAddrToStr(addr));
             if (dev != -1)
             {
-                smonFormat(addr, toscaSmonRead(addr|dev<<16));
+                smonFormat(addr, smonGet(addr|dev<<16));
             }
             else
             {
                 for (d = 0; d < devs; d++)
                 {
                     if (d) printf(" | ");
-                    smonFormat(addr, toscaSmonRead(addr|d<<16));
+                    smonFormat(addr, smonGet(addr|d<<16));
                 }
             }
             printf("\n");
         }
         return;
     }
-    addr = strtol(args[0].sval, &p, 0);
+    addr = strtol(addrstr, &p, 0);
     if (p == addrstr)
     {
         fprintf(stderr, "invalid address %s\n", addrstr);
         return;
     }
-    smonShow(addr, toscaSmonRead(addr));
+    if (dev != -1) addr |= dev<<16;
+    smonShow(addr, smonGet(addr));
+    smonShowStats(addr);
 }
 
 static const iocshFuncDef toscaSmonWriteDef =
@@ -264,12 +534,17 @@ static void toscaSmonClearFunc(const iocshArgBuf *args)
 
 struct regDevice
 {
-    void* nope;
+    struct toscaSmonSampler* sampler;
 };
 
-void smonDevReport(regDevice *device __attribute__((unused)), int level __attribute__((unused)))
+void smonDevReport(regDevice *device, int level)
 {
     printf("Tosca Virtex FPGA System Monitor\n");
+    if (level > 0 && device->sampler)
+    {
+        printf("       ");
+        toscaSmonSamplerReport(device->sampler);
+    }
 }
 
 int smonDevRead(
@@ -286,7 +561,16 @@ int smonDevRead(
 
     if (dlen != 2)
     {
-        error("%s %s: dlen must be 4 bytes", regDevName(device), user);
+        error("%s %s: dlen must be 2 bytes", regDevName(device), user);
+        return -1;
+    }
+    if (device->sampler &&
+        toscaSmonSamplerGet(device->sampler, offset, nelem, pdata, NULL) == 0)
+        return 0;
+    if (offset + nelem > SMON_REGS)
+    {
+        error("%s %s: registers 0x%zx-0x%zx are not sampled", regDevName(device), user,
+            offset, offset + nelem - 1);
         return -1;
     }
     for (i = 0; i < nelem; i++)
@@ -312,6 +596,18 @@ int smonDevWrite(
         error("%s %s: dlen must be 2 bytes", regDevName(device), user);
         return -1;
     }
+    if (offset >= SMON_REGS)
+    {
+        /* writing to statistics restarts them */
+        if (!device->sampler || offset + nelem > 4*SMON_REGS)
+        {
+            error("%s %s: no statistics at 0x%zx", regDevName(device), user, offset);
+            return -1;
+        }
+        for (i = 0; i < nelem; i++)
+            device->sampler->reset[(offset+i) & (SMON_REGS-1)] = 1;
+        return 0;
+    }
     if (pmask && *(epicsUInt16*)pmask != 0xffff)
     {
         epicsUInt16 mask = *(epicsUInt16*)pmask;
@@ -326,33 +622,58 @@ int smonDevWrite(
     return 0;
 }
 
+static IOSCANPVT smonDevGetInScanPvt(
+    regDevice *device,
+    size_t offset __attribute__((unused)),
+    unsigned int dlen __attribute__((unused)),
+    size_t nelm __attribute__((unused)),
+    int ivec __attribute__((unused)),
+    const char* user)
+{
+    if (!device->sampler)
+    {
+        error("%s %s: I/O Intr needs the sampler", regDevName(device), user);
+        return NULL;
+    }
+    return device->sampler->ioscanpvt;
+}
+
 struct regDevSupport smonDev = {
     .report = smonDevReport,
     .read = smonDevRead,
     .write = smonDevWrite,
+    .getInScanPvt = smonDevGetInScanPvt,
 };
 
-int toscaSmonDevConfigure(const char* name)
+int toscaSmonDevConfigure(const char* name, double period, const char* channels)
 {
     regDevice *device = NULL;
     
     if (!name || !name[0])
     {
-        printf("usage: toscaSmonDevConfigure name\n");
+        printf("usage: toscaSmonDevConfigure name [period] [channels]\n");
         return -1;
     }
-    device = malloc(sizeof(regDevice));
+    device = calloc(1, sizeof(regDevice));
     if (!device)
     {
         fprintf(stderr, "malloc regDevice failed: %m\n");
         goto fail;
     }
-    if (regDevRegisterDevice(name, &smonDev, device, 0x100) != SUCCESS)
+    if (period >= 0)
+    {
+        if (!toscaSmonSamplerFind(0) && toscaSmonSamplerStart(0, period, channels) != 0)
+            goto fail;
+        device->sampler = toscaSmonSamplerFind(0);
+    }
+    /* regDev counts the uint16 array elements in bytes while we count registers */
+    if (regDevRegisterDevice(name, &smonDev, device, 8*SMON_REGS) != SUCCESS)
     {
         fprintf(stderr, "regDevRegisterDevice() failed: %m\n");
         goto fail;
     }
-    if (regDevInstallWorkQueue(device, 100) != SUCCESS)
+    /* without sampler all reads go to the hardware, do that in a separate thread */
+    if (!device->sampler && regDevInstallWorkQueue(device, 100) != SUCCESS)
     {
         fprintf(stderr, "regDevInstallWorkQueue() failed: %m\n");
         return -1;
@@ -365,18 +686,33 @@ fail:
 }
 
 static const iocshFuncDef toscaSmonDevConfigureDef =
-    { "toscaSmonDevConfigure", 1, (const iocshArg *[]) {
+    { "toscaSmonDevConfigure", 3, (const iocshArg *[]) {
     &(iocshArg) { "name", iocshArgString },
+    &(iocshArg) { "period (s, default 1, <0: no sampler)", iocshArgDouble },
+    &(iocshArg) { "channels (default all measurements)", iocshArgString },
 }};
 
 static void toscaSmonDevConfigureFunc(const iocshArgBuf *args)
 {
-    toscaSmonDevConfigure(args[0].sval);
+    toscaSmonDevConfigure(args[0].sval, args[1].dval, args[2].sval);
+}
+
+static const iocshFuncDef toscaSmonSamplerDef =
+    { "toscaSmonSampler", 3, (const iocshArg *[]) {
+    &(iocshArg) { "device", iocshArgInt },
+    &(iocshArg) { "period (s, default 1)", iocshArgDouble },
+    &(iocshArg) { "channels (default all measurements)", iocshArgString },
+}};
+
+static void toscaSmonSamplerFunc(const iocshArgBuf *args)
+{
+    toscaSmonSamplerStart(args[0].ival, args[1].dval, args[2].sval);
 }
 
 static void toscaSmonRegistrar(void)
 {
     iocshRegister(&toscaSmonDevConfigureDef, toscaSmonDevConfigureFunc);
+    iocshRegister(&toscaSmonSamplerDef, toscaSmonSamplerFunc);
     iocshRegister(&toscaSmonReadDef, toscaSmonReadFunc);
     iocshRegister(&toscaSmonWriteDef, toscaSmonWriteFunc);
     iocshRegister(&toscaSmonWriteMaskedDef, toscaSmonWriteMaskedFunc);
@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <dbScan.h>
+#include <iocsh.h>
+#include <epicsStdioRedirect.h>
+
+#include <regDev.h>
+
+#include "toscaMap.h"
+#include "toscaDma.h"
+#include "toscaStream.h"
+
+#include <epicsExport.h>
+
+#define TOSCA_EXTERN_DEBUG
+#define TOSCA_DEBUG_NAME toscaStream
+#include "toscaDebug.h"
+epicsExportAddress(int, toscaStreamDebug);
+
+/* regDev binding for toscaStream:
+   Records read the newest nelem*dlen bytes of the stream.
+   I/O Intr records are processed whenever new data has arrived.
+*/
+
+struct regDevice
+{
+    const char* name;
+    toscaStream_t* stream;
+    unsigned int dmaspace;
+    uint64_t base;
+    size_t size;
+    double poll;
+    intrmask_t intrmask;
+    epicsEventId start;
+    int registered;
+    IOSCANPVT ioscanpvt;
+};
+
+void toscaStreamDevReport(regDevice *device, int level)
+{
+    toscaStreamStats_t stats = toscaStreamGetStats(device->stream);
+
+    printf("Tosca stream %s:0x%"PRIx64"[0x%zx] host ring 0x%zx",
+        toscaDmaSpaceToStr(device->dmaspace), device->base, device->size, stats.hostsize);
+    if (device->poll)
+        printf(", poll %gs", device->poll);
+    printf("\n");
+    if (level > 0)
+        printf("       %llu bytes in %llu transfers, %llu errors, %llu overruns, %llu bytes lost, fill 0x%zx\n",
+            (unsigned long long)stats.received, (unsigned long long)stats.transfers,
+            (unsigned long long)stats.errors, (unsigned long long)stats.overruns,
+            (unsigned long long)stats.lost, stats.fill);
+}
+
+int toscaStreamDevRead(
+    regDevice *device,
+    size_t offset,
+    unsigned int dlen,
+    size_t nelem,
+    void* pdata,
+    int priority __attribute__((unused)),
+    regDevTransferComplete callback __attribute__((unused)),
+    const char* user)
+{
+    size_t len;
+
+    if (offset != 0)
+    {
+        error("%s %s: offset must be 0", device->name, user);
+        return -1;
+    }
+    len = toscaStreamLatest(device->stream, pdata, nelem * dlen);
+    debugLvl(2, "%s %s: got 0x%zx of 0x%zx bytes", device->name, user, len, nelem * dlen);
+    if (len < nelem * dlen)
+        memset((char*)pdata + len, 0, nelem * dlen - len);
+    return len ? SUCCESS : -1;
+}
+
+static IOSCANPVT toscaStreamDevGetInScanPvt(
+    regDevice *device,
+    size_t offset __attribute__((unused)),
+    unsigned int dlen __attribute__((unused)),
+    size_t nelm __attribute__((unused)),
+    int ivec __attribute__((unused)),
+    const char* user __attribute__((unused)))
+{
+    return device->ioscanpvt;
+}
+
+struct regDevSupport toscaStreamDev = {
+    .report = toscaStreamDevReport,
+    .read = toscaStreamDevRead,
+    .getInScanPvt = toscaStreamDevGetInScanPvt,
+};
+
+static void toscaStreamDevNewData(regDevice *device, size_t newbytes __attribute__((unused)))
+{
+    scanIoRequest(device->ioscanpvt);
+}
+
+static void toscaStreamDevFree(regDevice *device)
+{
+    toscaStreamClose(device->stream);
+    /* With interrupts, the handler may still call toscaStreamDevNewData. */
+    if (!device->intrmask) free(device);
+}
+
+static void toscaStreamDevPollThread(regDevice *device)
+{
+    /* started before registration, thus it owns the device if that fails */
+    epicsEventMustWait(device->start);
+    epicsEventDestroy(device->start);
+    if (!device->registered)
+    {
+        toscaStreamDevFree(device);
+        return;
+    }
+    while (1)
+    {
+        toscaStreamUpdate(device->stream);
+        epicsThreadSleep(device->poll);
+    }
+}
+
+int toscaStreamDevConfigure(const char* name, unsigned int dmaspace, uint64_t base, size_t size,
+    unsigned int wrptrspace, uint64_t wrptraddr, const char* flags)
+{
+    regDevice* device;
+    unsigned int swap = 0;
+    size_t hostsize = 0;
+    intrmask_t intrmask = 0;
+
+    debug("toscaStreamDevConfigure(name=%s, dmaspace=%s, base=0x%"PRIx64" size=0x%zx, wrptr=%s:0x%"PRIx64", flags=\"%s\")",
+        name, toscaDmaSpaceToStr(dmaspace), base, size, toscaAddrSpaceToStr(wrptrspace), wrptraddr, flags);
+
+    if (regDevFind(name))
+    {
+        error("name \"%s\" already in use", name);
+        return -1;
+    }
+    if ((device = calloc(1, sizeof(regDevice))) == NULL)
+    {
+        error("cannot allocate device structure: %m");
+        return -1;
+    }
+    device->name = strdup(name);
+    device->dmaspace = dmaspace;
+    device->base = base;
+    device->size = size;
+
+    if (flags)
+    {
+        const char* p;
+        const char* q = flags;
+        size_t l;
+        while (*q)
+        {
+            p = q;
+            while (isspace(*p)) p++;
+            q = p;
+            while (*q && !isspace(*q)) q++;
+            if (!*p) break;
+            l = q-p;
+
+            if (strncasecmp(p, "NS", l) == 0) { swap = 0; continue; }
+            if (strncasecmp(p, "WS", l) == 0) { swap = 2; continue; }
+            if (strncasecmp(p, "DS", l) == 0) { swap = 4; continue; }
+            if (strncasecmp(p, "QS", l) == 0) { swap = 8; continue; }
+            if (strncasecmp(p, "intr=", 5) == 0) { intrmask |= TOSCA_USER1_INTR(strtoul(p+5, NULL, 0)); continue; }
+            if (strncasecmp(p, "poll=", 5) == 0) { device->poll = strtod(p+5, NULL); continue; }
+            if (strncasecmp(p, "hostsize=", 9) == 0) { hostsize = toscaStrToSize(p+9); continue; }
+            error("unknown flag %.*s", (int)l, p);
+        }
+    }
+    if (!intrmask && !device->poll)
+        device->poll = 0.01;
+
+    device->intrmask = intrmask;
+    scanIoInit(&device->ioscanpvt);
+    device->stream = toscaStreamOpen(dmaspace, base, size, swap, wrptrspace, wrptraddr, hostsize, intrmask,
+        (toscaStreamCallback)toscaStreamDevNewData, device);
+    if (!device->stream)
+    {
+        error("toscaStreamOpen failed: %m");
+        free(device);
+        return -1;
+    }
+
+    if (device->poll)
+    {
+        char threadname[32];
+        snprintf(threadname, sizeof(threadname), "stream-%s", name);
+        device->start = epicsEventMustCreate(epicsEventEmpty);
+        if (!epicsThreadCreate(threadname, epicsThreadPriorityHigh,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            (EPICSTHREADFUNC)toscaStreamDevPollThread, device))
+        {
+            error("cannot start poll thread");
+            epicsEventDestroy(device->start);
+            toscaStreamDevFree(device);
+            return -1;
+        }
+    }
+
+    if (regDevRegisterDevice(name, &toscaStreamDev, device, toscaStreamGetStats(device->stream).hostsize / 2) != SUCCESS)
+    {
+        error("regDevRegisterDevice() failed");
+        if (device->poll)
+        {
+            epicsEventSignal(device->start); /* poll thread cleans up */
+            return -1;
+        }
+        toscaStreamDevFree(device);
+        return -1;
+    }
+    device->registered = 1;
+    if (device->poll)
+        epicsEventSignal(device->start);
+    return 0;
+}
+
+static const iocshFuncDef toscaStreamDevConfigureDef =
+    { "toscaStreamDevConfigure", 5, (const iocshArg *[]) {
+    &(iocshArg) { "name", iocshArgString },
+    &(iocshArg) { "dmaspace:address", iocshArgString },
+    &(iocshArg) { "size", iocshArgString },
+    &(iocshArg) { "wrptr addrspace:address", iocshArgString },
+    &(iocshArg) { "flags", iocshArgArgv },
+}};
+
+static void toscaStreamDevConfigureFunc(const iocshArgBuf *args)
+{
+    toscaMapAddr_t addr, wrptr;
+    size_t size;
+    unsigned int i, l=0;
+    char flags[80] = "";
+
+    if (!args[0].sval)
+    {
+        iocshCmd("help toscaStreamDevConfigure");
+        printf("dmaspace: SMEM, SMEM2, USER1, USER2\n"
+               "   address and size can use k,M,G suffix for powers of 1024\n"
+               "wrptr: register with the write position (byte offset), e.g. USER1:0x100\n"
+               "flags:\n"
+               "   - swap: NS (none), WS (word), DS (double word) QS (quad word)\n"
+               "   - intr=0...15 (USER1 interrupt line signalling new data)\n"
+               "   - poll= (seconds, default 0.01 if no intr given)\n"
+               "   - hostsize= (host ring buffer size, default and minimum 2*size)\n"
+        );
+        return;
+    }
+
+    addr = toscaStrToAddr(args[1].sval, NULL);
+    if (!addr.addrspace)
+    {
+        error("invalid address space %s", args[1].sval);
+        return;
+    }
+    size = toscaStrToSize(args[2].sval);
+    wrptr = toscaStrToAddr(args[3].sval, NULL);
+    if (!wrptr.addrspace)
+    {
+        error("invalid write pointer address %s", args[3].sval);
+        return;
+    }
+
+    for (i = 1; i < (unsigned int)args[4].aval.ac && l < sizeof(flags); i++)
+        l += sprintf(flags+l, "%.*s ", (int)sizeof(flags)-l, args[4].aval.av[i]);
+    if (l) flags[l-1] = 0;
+
+    if (toscaStreamDevConfigure(args[0].sval, addr.addrspace, addr.address, size,
+        wrptr.addrspace, wrptr.address, flags) != 0)
+    {
+        fprintf(stderr, "toscaStreamDevConfigure failed: %m\n");
+    }
+}
+
+static void toscaStreamDevRegistrar(void)
+{
+    iocshRegister(&toscaStreamDevConfigureDef, toscaStreamDevConfigureFunc);
+    toscaStreamDebug = 0;
+}
+
+epicsExportRegistrar(toscaStreamDevRegistrar);
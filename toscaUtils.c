@@ -200,6 +200,12 @@ void memcopyFunc(const iocshArgBuf *args)
 
     if (toscaDmaDebug)
         clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    if (toscaMapReadAhead && toscaMapFind(sourceptr).addrspace && (width == 0 || width == -2 || width == -4 || width == -8))
+    {
+        /* reading from Tosca: use wide loads (toscaMapReadAhead=0 for the old element copy) */
+        toscaMapCopyFrom((void*)destptr, sourceptr, size, -width);
+    }
+    else
     switch (width)
     {
         case 0: